@@ -0,0 +1,14 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/* Defaults for the bench command, chosen so a run takes a few seconds */
+#define BENCH_DEPTH 7
+#define BENCH_THREADS 1
+#define BENCH_HASH_MB 16
+
+extern const char* bench_positions[];
+extern const int num_bench_positions;
+
+void bench(int depth, int threads, int hash_mb);
+
+#endif
@@ -5,6 +5,12 @@
 
 #define MOVES_PER_POSITION 218
 
+/* Plies without a capture or pawn move after which the game is drawn */
+#define FIFTY_MOVE_PLIES 100
+
+/* Longest game plus search line kept for repetition detection */
+#define MAX_GAME_PLY 2048
+
 #define RANK_1 0x00000000000000FFULL
 #define RANK_2 0x000000000000FF00ULL
 #define RANK_3 0x0000000000FF0000ULL
@@ -42,6 +48,8 @@ typedef struct
     uint64_t en_p;
     uint64_t castle;
     int to_move;
+    int halfmove;
+    int fullmove;
     uint64_t hash;
 } Board;
 
@@ -60,17 +68,6 @@ typedef struct
     int weight;
 } Cand;
 
-typedef struct
-{
-    uint64_t nodes;
-    uint64_t caps;
-    uint64_t eps;
-    uint64_t checks;
-    uint64_t checkmates;
-    uint64_t castles;
-    uint64_t proms;
-} Pres;
-
 extern const uint64_t RDIAG;
 extern const uint64_t RDIAG;
 extern const uint64_t LDIAG;
@@ -82,15 +79,20 @@ extern const uint64_t PATTK;
 
 extern const Move default_move;
 
-#define LINE_LENGTH 20
-extern Move current_line[LINE_LENGTH];
  
+void board_init();
 void set_default(Board* board);
 void move_piece(Board* board, Move* move);
 void undo_move(Board* board, Move* move);
 void update_combined_pos(Board* board);
+void clear_positions();
 void add_position(Board* board);
+void remove_position();
 int is_threefold(Board* board);
+int repetition_count(Board* board);
+int is_material_draw(Board* board);
+int has_game_cycle(Board* board, int ply);
+int comp_cand(const void* one, const void* two);
 
 uint64_t gen_pawn_moves(Board* board, int color, uint64_t pieces);
 uint64_t gen_bishop_moves(Board* board, int color, uint64_t pieces);
@@ -99,20 +101,33 @@ uint64_t gen_queen_moves(Board* board, int color, uint64_t pieces);
 uint64_t gen_knight_moves(Board* board, int color, uint64_t pieces);
 uint64_t gen_king_moves(Board* board, int color, uint64_t pieces);
 uint64_t gen_all_attacks(Board* board, int color);
+uint64_t gen_all_dests(Board* board, int color);
+int gen_all_moves(Board* board, Cand* movearr);
+int gen_search_moves(Board* board, Cand* movearr);
+int gen_search_attack_moves(Board* board, Cand* movearr);
+int gen_moves(Board* board, Cand* movearr, int weigh);
+int count_legal_moves(Board* board);
+int gen_all_attack_moves(Board* board, Cand* movearr);
+int gen_all_attacks_on_square(Board* board, Cand* movearr, uint64_t square);
+int keep_attacks_on_square(Cand* cans, int num_moves, uint64_t square);
 
-Move find_best_move(Board* board, int depth, int time);
 int get_board_value(Board* board);
-int extract_moves(Board* board, int color, uint64_t src, Cand* movearr);
+uint64_t gen_piece_moves(Board* board, int color, uint64_t src, int* piece);
+int extract_moves(Board* board, int color, uint64_t src, Cand* movearr,
+        int weigh);
 int is_legal(Board* board, Move move);
 void apply_heuristics(Board* board, Cand* cand);
 int get_piece_value(Board* board, int color, uint64_t piece);
 int is_checkmate(Board* board, int color);
+int is_in_check(Board* board, int color);
+int least_valuable_attacker(Board* board, uint64_t square, Move* move);
+int see_square(Board* board, uint64_t square);
+int see(Board* board, Move* move);
 int will_be_checkmate(Board* board, int color, Move* move);
 int will_be_check(Board* board, int color, Move* move);
 int is_stalemate(Board* board, int color);
 
 int bitScanForward(uint64_t bb);
+uint16_t pack_move(Move* move);
 
-Pres perft(Board* board, int depth);
-void get_nodes(Board* board, Cand* cand, int depth, Pres* pres);
 #endif
@@ -1,11 +1,27 @@
 #ifndef IO_H
 #define IO_H
 
+#define OUT_BUFFER_SIZE 4096
+
+/* Output is collected here and written with a single syscall on flush */
+typedef struct
+{
+    int fd;
+    int len;
+    char data[OUT_BUFFER_SIZE];
+} OutBuffer;
+
 void print_board(Board* board);
 void print_move(int fd, Move* move);
 void print_location(int fd, uint64_t board);
 void load_fen(Board* board, char* fen);
 uint64_t square_to_bit(char* square);
 void find_piece(Board* board, Move* move);
+void parse_move(Board* board, char* str, Move* move);
+int is_move_string(char* str);
+void buf_init(OutBuffer* out, int fd);
+void buf_printf(OutBuffer* out, char* format, ...);
+void buf_move(OutBuffer* out, Move* move);
+void buf_flush(OutBuffer* out);
 
 #endif
@@ -0,0 +1,98 @@
+#ifndef PERFT_H
+#define PERFT_H
+
+#include <stdatomic.h>
+#include "board.h"
+
+/* Longest line accepted from an EPD file of perft positions */
+#define EPD_LINE_LENGTH 512
+
+/* Most depths with an expected node count on one EPD line */
+#define EPD_MAX_DEPTH 16
+
+/* Default size of the perft hash table in MB */
+#define PERFT_HASH_MB 64
+
+/* Most threads a perft run may use, and the deepest ply it may be split at.
+ * Every move at the split ply takes a PerftWork of its own, so a split at ply
+ * 4 would need millions of them in busy positions. Three plies already give
+ * tens of thousands of subtrees, far more than there are threads. */
+#define PERFT_MAX_THREADS 256
+#define PERFT_MAX_SPLIT 3
+
+/* Node count of a subtree, stored by position and remaining depth. data holds
+ * the node count above the low PERFT_DEPTH_BITS bits, which hold the depth,
+ * and key is the position hash XORed with data. Threads share the table
+ * without locks; an entry torn by two writers no longer matches its hash and
+ * is treated as a miss. */
+#define PERFT_DEPTH_BITS 8
+typedef struct
+{
+    uint64_t key;
+    uint64_t data;
+} PerftEntry;
+
+typedef struct
+{
+    uint64_t nodes;
+    uint64_t caps;
+    uint64_t eps;
+    uint64_t checks;
+    uint64_t checkmates;
+    uint64_t castles;
+    uint64_t proms;
+} Pres;
+
+/* The board and move list of one ply of the perft recursion. Every thread
+ * walks its subtrees with an array of these indexed by ply, as the search
+ * does with its SearchStack, so that no move list lives on the C stack. */
+typedef struct
+{
+    Board board;
+    Cand moves[MOVES_PER_POSITION];
+} PerftPly;
+
+/* One subtree of a parallel perft: a move at the split ply, the position it
+ * is made from and the root move it descends from */
+typedef struct
+{
+    Board board;
+    Cand cand;
+    int root;
+    Pres pres;
+} PerftWork;
+
+/* A perft run split into subtrees that the worker threads take in turn.
+ * failed is set when the run could not allocate what it needed, in which case
+ * its counts are meaningless. */
+typedef struct
+{
+    int depth;
+    int threads;
+    int split;
+    int use_hash;
+    int stats;
+    PerftWork* work;
+    int num_work;
+    int work_size;
+    atomic_int next_work;
+    int failed;
+} PerftJob;
+
+PerftPly* perft_stack_alloc(int depth);
+Pres perft(Board* board, int depth);
+void get_nodes(Board* board, Cand* cand, int depth, Pres* pres,
+        PerftPly* stack);
+void perft_hash_resize(uint64_t mb);
+void perft_hash_clear();
+uint64_t perft_count(Board* board, int depth, int use_hash, PerftPly* stack);
+void perft_add_work(PerftJob* job, Board* board, int ply, int root,
+        PerftPly* stack);
+void* perft_worker(void* arg);
+Pres perft_parallel(Board* board, PerftJob* job, uint64_t* root_nodes);
+void perft_divide(Board* board, PerftJob* job);
+int perft_epd_line(char* line, int max_depth, int number, uint64_t* nodes,
+        long* time);
+int perft_suite(char* filename, int max_depth);
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdatomic.h>
+#include "board.h"
+#include "zobrist.h"
+#include "timeman.h"
+#include "io.h"
+
+#define MAX_PLY 64
+#define MATE_SCORE 300
+#define MATE_BOUND (MATE_SCORE - MAX_PLY)
+#define DRAW_SCORE 0
+
+/* Late move reductions and late move pruning */
+#define LMR_MIN_DEPTH 3
+#define LMR_MIN_MOVES 2
+#define LMP_MAX_DEPTH 3
+#define HISTORY_MAX 16384
+#define HISTORY_REDUCTION_DIVISOR 8192
+
+/* Depth limits for reverse futility, futility and razoring */
+#define RFP_MAX_DEPTH 3
+#define FUTILITY_MAX_DEPTH 3
+#define RAZOR_MAX_DEPTH 2
+
+/* Aspiration windows around the previous iteration's score, in pawns */
+#define ASPIRATION_MIN_DEPTH 3
+#define ASPIRATION_DELTA 1
+#define ASPIRATION_MAX_DELTA 8
+
+/* ProbCut at deep non-PV nodes */
+#define PROBCUT_MIN_DEPTH 5
+#define PROBCUT_MARGIN 2
+#define PROBCUT_REDUCTION 4
+
+/* Check and singular extensions */
+#define SE_MIN_DEPTH 4
+#define SE_MARGIN 1
+#define MAX_LINE_EXTENSIONS 4
+
+/* Everything the search keeps for one ply, so that no move list or board copy
+ * has to live on the C stack of the recursion */
+typedef struct
+{
+    Board board;
+    Cand moves[MOVES_PER_POSITION];
+    Move quiets[MOVES_PER_POSITION];
+    Move killers[2];
+    Move excluded;
+    int in_check;
+    int extensions;
+    int pv_follow;
+    int tt_result;
+} SearchStack;
+
+/* A move at the root with its last score and the nodes its subtree took in
+ * the current iteration */
+typedef struct
+{
+    Move move;
+    int score;
+    uint64_t nodes;
+} RootMove;
+
+typedef struct
+{
+    char* name;
+    int* value;
+    int min;
+    int max;
+} SearchParam;
+
+extern SearchStack* search_stack;
+extern uint64_t nodes;
+extern atomic_int stop_search;
+extern atomic_int pondering;
+extern TimeManager time_manager;
+extern int rfp_margin;
+extern int futility_margin;
+extern int razor_margin;
+extern int multi_pv;
+
+/* Depth searched when the fast path decides there is nothing to think about */
+#define FAST_PATH_DEPTH 2
+
+/* Delay before currmove lines start and the minimum gap between them, msec */
+#define CURRMOVE_DELAY 1000
+#define CURRMOVE_INTERVAL 100
+
+extern int debug_mode;
+
+void search_init();
+void print_search_params(int fd);
+int set_search_param(char* name, int value);
+void search_clear();
+int check_stop();
+int fifty_move_score(Board* board, int in_check, int ply);
+int alphaBeta(Board* board, int alpha, int beta, int depth, int ply);
+int quiesce(Board* board, int alpha, int beta, int ply);
+int search_child(Board* child, Move* move, int alpha, int beta, int depth,
+        int ply, int reduction);
+int score_to_tt(int score, int ply);
+int score_from_tt(int score, int ply);
+int search_root(Board* board, RootMove* roots, int num_moves, int alpha,
+        int beta, int depth);
+int comp_root_nodes(const void* one, const void* two);
+void update_pv(Move* move, int ply);
+void buf_pv(OutBuffer* out, Move* best);
+void report_iteration(Move* best, int depth, int line, int score, int bound);
+void report_currmove(Move* move, int depth, int number);
+void find_ponder_move(Board* board, Move* move, Move* ponder);
+void ponderhit(SearchLimits* limits, int color);
+int search_line(Board* board, RootMove* roots, int num_moves, int score,
+        int depth, int line);
+int gen_root_moves(Board* board, RootMove* roots, SearchLimits* limits);
+char* fast_path(Board* board, RootMove* roots, int num_moves,
+        SearchLimits* limits, Move* move);
+Move find_best_move(Board* board, SearchLimits* limits, Move* ponder);
+
+#endif
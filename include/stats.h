@@ -0,0 +1,67 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+/* Search statistics are only collected in builds made with -DSEARCH_STATS,
+ * as "make stats" does. Otherwise every STAT_ macro expands to nothing. */
+#ifdef SEARCH_STATS
+#define STATS_ENABLED 1
+#else
+#define STATS_ENABLED 0
+#endif
+
+/* Nodes are counted per ply up to this one, the same as MAX_PLY */
+#define STATS_PLIES 64
+
+/* Beta cutoffs are counted by the index of the move that caused them. Later
+ * moves share the last bucket. */
+#define STATS_MOVE_INDICES 8
+
+/* Parts of the search whose time is measured. Legality checks happen inside
+ * move generation, so PHASE_GEN includes PHASE_LEGALITY. */
+enum stats_phase
+{
+    PHASE_GEN = 0,
+    PHASE_LEGALITY,
+    PHASE_EVAL,
+    PHASE_TT,
+    NUM_PHASES
+};
+
+typedef struct
+{
+    uint64_t main_nodes;
+    uint64_t qnodes;
+    uint64_t nodes_by_ply[STATS_PLIES];
+    uint64_t tt_probes;
+    uint64_t tt_hits;
+    uint64_t tt_cutoffs;
+    uint64_t beta_cutoffs[STATS_MOVE_INDICES];
+    uint64_t illegal_moves;
+    uint64_t phase_ticks[NUM_PHASES];
+} SearchStats;
+
+#ifdef SEARCH_STATS
+extern SearchStats search_stats;
+#define STAT_INC(field) (search_stats.field++)
+#define STAT_PLY(ply) (search_stats.nodes_by_ply[(ply) < STATS_PLIES ? \
+        (ply) : STATS_PLIES - 1]++)
+#define STAT_CUTOFF(index) (search_stats.beta_cutoffs[ \
+        (index) < STATS_MOVE_INDICES ? (index) : STATS_MOVE_INDICES - 1]++)
+#define STAT_TIMER_START(name) uint64_t name = stats_ticks()
+#define STAT_TIMER_STOP(name, phase) \
+    (search_stats.phase_ticks[phase] += stats_ticks() - (name))
+#else
+#define STAT_INC(field) ((void)0)
+#define STAT_PLY(ply) ((void)0)
+#define STAT_CUTOFF(index) ((void)0)
+#define STAT_TIMER_START(name)
+#define STAT_TIMER_STOP(name, phase) ((void)0)
+#endif
+
+uint64_t stats_ticks();
+void stats_clear();
+void stats_print();
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef TIMEMAN_H
+#define TIMEMAN_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "board.h"
+
+/* Nodes searched between two looks at the clock */
+#define TIME_CHECK_NODES 1024
+
+/* Time kept in reserve for communication with the GUI, in msec */
+#define MOVE_OVERHEAD 30
+
+/* Number of moves to plan for when the GUI does not send movestogo */
+#define DEFAULT_MOVES_TO_GO 30
+
+/* Node share of the best root move, in percent, at which the soft limit is
+ * left unchanged. A larger share shortens it, a smaller one stretches it. */
+#define NODE_SHARE_NEUTRAL 60
+
+typedef struct
+{
+    int depth;
+    int wtime;
+    int btime;
+    int winc;
+    int binc;
+    int movestogo;
+    int movetime;
+    uint64_t nodes;
+    int infinite;
+    int ponder;
+    uint16_t searchmoves[MOVES_PER_POSITION];
+    int num_searchmoves;
+} SearchLimits;
+
+/* The start and the limits are atomic because ponderhit replaces them from
+ * the UCI thread while the search thread reads them */
+typedef struct
+{
+    atomic_long start;
+    atomic_long soft_limit;
+    atomic_long hard_limit;
+    uint64_t max_nodes;
+    long last_iteration;
+    int instability;
+} TimeManager;
+
+long get_time_ms();
+void clear_limits(SearchLimits* limits);
+void tm_init(TimeManager* tm, SearchLimits* limits, int color);
+void tm_ponderhit(TimeManager* tm, SearchLimits* limits, int color);
+long tm_elapsed(TimeManager* tm);
+int tm_out_of_time(TimeManager* tm, uint64_t nodes);
+int tm_stop_iterating(TimeManager* tm, long iteration_time, int best_changed,
+        int best_share);
+
+#endif
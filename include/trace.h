@@ -0,0 +1,91 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "board.h"
+
+/* Trace files are a sequence of searches, each a TraceHeader followed by
+ * its records in the order they were written */
+#define TRACE_MAGIC 0x4352544CU
+#define TRACE_VERSION 2
+
+/* Records kept per search, a power of two. Once the ring is full the oldest
+ * records are overwritten. */
+#define TRACE_RING_RECORDS (1 << 20)
+
+#define TRACE_PATH_LENGTH 256
+
+/* ProbCut records are the quiescence and reduced searches of a ProbCut
+ * capture. A singular record is the exclusion search of the node recorded
+ * after it at the same ply, with the excluded move as its move. */
+enum trace_node_type
+{
+    TRACE_PV = 0,
+    TRACE_NONPV,
+    TRACE_QS,
+    TRACE_PROBCUT,
+    TRACE_SINGULAR,
+    NUM_TRACE_TYPES
+};
+
+enum trace_tt_result
+{
+    TRACE_TT_NONE = 0,
+    TRACE_TT_MISS,
+    TRACE_TT_HIT,
+    TRACE_TT_CUTOFF
+};
+
+enum trace_bound
+{
+    TRACE_EXACT = 0,
+    TRACE_FAIL_HIGH,
+    TRACE_FAIL_LOW
+};
+
+/* One searched node, written when its search returns, so children come
+ * before their parent. The window, score and bound are seen from the side
+ * not to move at the node, so the windows of a node's children lie inside
+ * its own window negated. */
+typedef struct
+{
+    uint16_t move;
+    int16_t alpha;
+    int16_t beta;
+    int16_t score;
+    uint8_t ply;
+    uint8_t depth;
+    uint8_t reduction;
+    uint8_t type;
+    uint8_t tt;
+    uint8_t bound;
+    uint16_t unused;
+} TraceRecord;
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint64_t written;
+    uint64_t count;
+    uint64_t nodes;
+} TraceHeader;
+
+/* Ring of records owned by one search thread, which is the only writer */
+typedef struct
+{
+    TraceRecord* records;
+    uint64_t written;
+} TraceBuffer;
+
+extern TraceBuffer trace_buffer;
+extern char trace_file[TRACE_PATH_LENGTH];
+
+void trace_enable(char* filename);
+void trace_clear();
+void trace_node(int ply, Move* move, int alpha, int beta, int score,
+        int depth, int reduction, int type, int tt);
+void trace_flush(uint64_t nodes);
+
+#endif
@@ -5,9 +5,18 @@
 
 #define RANDOM_SIZE 781
 #define HASH_SIZE 0xFFFFFFFFFFFFFFFFULL
-#define TABLE_SIZE (0xFFFFFFF) 
 #define DEFUALT_VALUE 3000
 
+/* Size of the transposition table in MB, rounded down to a power of two
+ * number of entries */
+#define DEFAULT_HASH_MB 4096
+#define MAX_HASH_MB 65536
+
+/* Cuckoo table of reversible piece moves for upcoming repetition detection */
+#define CUCKOO_SIZE 8192
+#define CUCKOO_H1(key) ((key) & (CUCKOO_SIZE - 1))
+#define CUCKOO_H2(key) (((key) >> 16) & (CUCKOO_SIZE - 1))
+
 #define BLACK_TO_MOVE (64 * 12)
 #define KW_CASTLE (64 * 12 + 1)
 #define QW_CASTLE (64 * 12 + 2)
@@ -15,19 +24,36 @@
 #define QB_CASTLE (64 * 12 + 4)
 #define EN_P_BEGIN (64 * 12 + 5)
 
+enum bound_type
+{
+    EXACT_BOUND = 0,
+    LOWER_BOUND,
+    UPPER_BOUND
+};
+
 typedef struct
 {
     uint64_t hash;
+    int16_t score;
+    uint16_t move;
     uint8_t depth;
-    int score;
+    uint8_t flag;
 } TEntry;
 
+extern uint64_t table_size;
+
 void zobrist_init();
+void cuckoo_init();
+int cuckoo_lookup(uint64_t key, int* src, int* dest);
+void zobrist_resize(uint64_t mb);
 void zobrist_clear();
 int is_hashed(Board* board, int depth);
 int get_hashed_value(Board* board);
 uint64_t hash_position(Board* board);
 void set_hashed_value(Board* board, int val, int depth);
+int probe_hash(Board* board, TEntry* entry);
+int hashfull();
+void store_hash(Board* board, int score, int depth, int flag, uint16_t move);
 void update_hash_move(Board* board, Move* move);
 void update_hash_direct(Board* board, int ind);
 
@@ -0,0 +1,90 @@
+#include <string.h>
+#include "board.h"
+#include "io.h"
+#include "zobrist.h"
+#include "search.h"
+#include "timeman.h"
+#include "bench.h"
+
+/* Fixed positions searched by the bench command. Changing this list changes
+ * the bench signature. */
+const char* bench_positions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+    "r1bq1rk1/ppp2ppp/2np1n2/2b1p3/2B1P3/2NP1N2/PPP2PPP/R1BQ1RK1 w - - 0 7",
+    "r2q1rk1/pp2bppp/2n1pn2/3p4/3P4/2NBPN2/PP3PPP/R2Q1RK1 w - - 0 10",
+    "2rr2k1/pp3ppp/2n1bn2/q3p3/4P3/1BN1BP2/PPPQ2PP/2KR3R w - - 0 15",
+    "r4rk1/1pp1qppp/p1np1n2/4p3/2B1P1b1/P1NP1N2/1PP2PPP/R2Q1RK1 w - - 0 10",
+    "8/5pk1/6p1/8/3R4/6P1/5PK1/r7 w - - 0 1",
+    "8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 1",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+    "4r1k1/pp3ppp/2p5/8/2P5/1P3N2/P4PPP/4R1K1 b - - 0 20",
+};
+const int num_bench_positions = sizeof(bench_positions) / sizeof(char*);
+
+/*******************************************************************************
+ * Searches every bench position to a fixed depth from a cleared transposition
+ * table and prints the total node count, which serves as a signature of the
+ * search, along with the time taken and the nodes per second. The summary is
+ * printed once for people and once as a single line for scripts.
+ *
+ * @param depth The depth to search each position to
+ * @param threads The number of search threads. Leape searches on one thread,
+ *                so this is reported but has no effect
+ * @param hash_mb The size of the transposition table to use in MB. The
+ *                previous size is restored afterwards
+ ******************************************************************************/
+void bench(int depth, int threads, int hash_mb)
+{
+    uint64_t old_mb = table_size * sizeof(TEntry) / (1024 * 1024);
+    if (depth < 1)
+        depth = BENCH_DEPTH;
+    if (threads < 1)
+        threads = BENCH_THREADS;
+    if (hash_mb < 1)
+        hash_mb = BENCH_HASH_MB;
+    zobrist_resize(hash_mb);
+
+    uint64_t total_nodes = 0;
+    long start = get_time_ms();
+    int i;
+    for (i = 0; i < num_bench_positions; ++i)
+    {
+        OutBuffer out;
+        buf_init(&out, 1);
+        buf_printf(&out, "info string position %d/%d %s\n", i + 1,
+                num_bench_positions, bench_positions[i]);
+        buf_flush(&out);
+
+        Board board;
+        char fen[100];
+        strcpy(fen, bench_positions[i]);
+        load_fen(&board, fen);
+        zobrist_clear();
+        SearchLimits limits;
+        clear_limits(&limits);
+        limits.depth = depth;
+        stop_search = 0;
+        pondering = 0;
+        Move ponder;
+        find_best_move(&board, &limits, &ponder);
+        total_nodes += nodes;
+    }
+    long elapsed = get_time_ms() - start;
+    uint64_t nps = total_nodes * 1000 / (elapsed ? elapsed : 1);
+
+    OutBuffer out;
+    buf_init(&out, 1);
+    buf_printf(&out, "\n===========================\n");
+    buf_printf(&out, "Total time (ms) : %ld\n", elapsed);
+    buf_printf(&out, "Nodes searched  : %llu\n",
+            (unsigned long long)total_nodes);
+    buf_printf(&out, "Nodes/second    : %llu\n", (unsigned long long)nps);
+    buf_printf(&out, "bench nodes %llu time %ld nps %llu depth %d threads 1 "
+            "hash %d\n", (unsigned long long)total_nodes, elapsed,
+            (unsigned long long)nps, depth, hash_mb);
+    buf_flush(&out);
+
+    if (old_mb)
+        zobrist_resize(old_mb);
+}
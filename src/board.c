@@ -5,8 +5,14 @@
 #include "board.h"
 #include "io.h"
 #include "zobrist.h"
+#include "stats.h"
 
-char* position_hashes = NULL;
+/* Zobrist keys of the game so far followed by those of the search line */
+uint64_t position_keys[MAX_GAME_PLY];
+int num_positions = 0;
+
+/* Squares strictly between two squares on a shared line, else empty */
+uint64_t between_squares[64][64];
 
 /* Constants for piece attacks */
 const uint64_t RDIAG = 0x0102040810204080ULL;
@@ -17,7 +23,9 @@ const uint64_t NMOV  = 0x0000000A1100110AULL;
 const uint64_t KMOV  = 0x0000000000070507ULL;
 const uint64_t PATTK = 0x0000000000050005ULL;
 
-Move current_line[LINE_LENGTH];
+/* Piece values for static exchange evaluation. Capturing the king ends any
+ * exchange, so a king recapture onto a defended square is never played */
+const int see_values[6] = {1, 3, 3, 5, 9, 100};
 
 /* Table used for determining bit index */
 const int index64[64] = {
@@ -67,6 +75,20 @@ int bitScanReverse(uint64_t bb)
     return index64[(bb * debruijn64) >> 58];
 }
 
+/*******************************************************************************
+ * Packs a move into 16 bits for storage in the transposition table. The source
+ * and destination squares take six bits each and the promotion piece the rest.
+ * A packed value of 0 never describes a real move.
+ *
+ * @param move The move to pack
+ * @return The packed move
+ ******************************************************************************/
+uint16_t pack_move(Move* move)
+{
+    return bitScanForward(move->src) | (bitScanForward(move->dest) << 6) |
+        ((move->promote + 1) << 12);
+}
+
 /*******************************************************************************
  * Returns a bit mask for a vertical portion of the bit board
  *
@@ -100,9 +122,6 @@ uint64_t vert_mask(int count)
  ******************************************************************************/
 void set_default(Board* board)
 {
-    if (position_hashes)
-        free(position_hashes);
-    position_hashes = calloc(TABLE_SIZE, sizeof(char));
     memset(board, 0, sizeof(Board));
     board->pieces[WHITE + PAWN]   = 0x000000000000FF00ULL;
     board->pieces[WHITE + BISHOP] = 0x0000000000000024ULL;
@@ -119,10 +138,11 @@ void set_default(Board* board)
     board->castle                 = 0x2200000000000022ULL;
     board->en_p                   = 0x0000000000000000ULL;
     board->to_move                = WHITE;
+    board->fullmove               = 1;
     update_combined_pos(board);
     board->hash = hash_position(board);
+    clear_positions();
     add_position(board);
-    memset(current_line, 0, sizeof(Move) * LINE_LENGTH);
 }
 
 /*******************************************************************************
@@ -169,10 +189,14 @@ int comp_cand(const void* one, const void* two)
 void move_piece(Board* board, Move* move)
 {
     int i;
+    board->halfmove++;
+    if (move->piece == PAWN)
+        board->halfmove = 0;
     for (i = 0; i < 12; ++i)
     {
         if (board->pieces[i] & move->dest)
         {
+            board->halfmove = 0;
             board->pieces[i] &= ~move->dest;
             int ind = bitScanForward(move->dest);
             update_hash_direct(board, 64 * i + ind);
@@ -246,7 +270,10 @@ void move_piece(Board* board, Move* move)
     if (board->to_move == WHITE)
         board->to_move = BLACK;
     else
+    {
         board->to_move = WHITE;
+        board->fullmove++;
+    }
     update_hash_direct(board, BLACK_TO_MOVE);
 
     if (board->en_p)
@@ -647,13 +674,13 @@ void update_combined_pos(Board* board)
         board->castle &= ~RANK_1;
     }
     if (!(board->pieces[BLACK + KING] & (0x08ULL << 56)) && (board->castle &
-                RANK_7))
+                RANK_8))
     {
         if (board->castle & (0xFULL << (8 * 7)))
             update_hash_direct(board, KB_CASTLE);
         if (board->castle & (0xF0ULL << (8 * 7)))
             update_hash_direct(board, QB_CASTLE);
-        board->castle &= ~RANK_7;
+        board->castle &= ~RANK_8;
     }
     if (!(board->pieces[WHITE + ROOK] & 0x01ULL) && (board->castle & 0x0FULL))
     {
@@ -709,7 +736,54 @@ uint64_t gen_all_dests(Board* board, int color)
  ******************************************************************************/
 int gen_all_moves(Board* board, Cand* movearr)
 {
-    memset(movearr, 0, sizeof(Cand) * MOVES_PER_POSITION);
+    return gen_moves(board, movearr, 1);
+}
+
+/*******************************************************************************
+ * Populates an array with all possible moves on the current board for the
+ * search, which orders them itself. The move ordering heuristics of
+ * gen_all_moves are skipped and every weight is left at 0.
+ *
+ * @param board The board to generate moves from
+ * @param movearr The array of moves to populate with the created moves. Its
+ *                length will always be of the constant MOVES_PER_POSITION
+ ******************************************************************************/
+int gen_search_moves(Board* board, Cand* movearr)
+{
+    return gen_moves(board, movearr, 0);
+}
+
+/*******************************************************************************
+ * Populates an array with all possible moves of the side to move that attack
+ * an enemy piece, for the search. Like gen_search_moves the weights are left
+ * at 0.
+ *
+ * @param board The board to generate moves from
+ * @param movearr The array of moves to populate with the created moves. Its
+ *                length will always be of the constant MOVES_PER_POSITION
+ ******************************************************************************/
+int gen_search_attack_moves(Board* board, Cand* movearr)
+{
+    int num_moves = gen_moves(board, movearr, 0);
+    uint64_t pieces;
+    if (board->to_move == WHITE)
+        pieces = board->all_black;
+    else
+        pieces = board->all_white;
+    return keep_attacks_on_square(movearr, num_moves, pieces);
+}
+
+/*******************************************************************************
+ * Generates the moves of the side to move, shared by gen_all_moves and
+ * gen_search_moves
+ *
+ * @param board The board to generate moves from
+ * @param movearr The array of moves to populate
+ * @param weigh Whether to weigh the moves with apply_heuristics
+ * @return The number of moves
+ ******************************************************************************/
+int gen_moves(Board* board, Cand* movearr, int weigh)
+{
     int nmoves = 0;
     uint64_t pieces = EMPTY;
     if (board->to_move == WHITE)
@@ -719,13 +793,47 @@ int gen_all_moves(Board* board, Cand* movearr)
     uint64_t lsb = pieces & -pieces;
     while (lsb)
     {
-        nmoves += extract_moves(board, board->to_move, lsb, movearr + nmoves);
+        nmoves += extract_moves(board, board->to_move, lsb, movearr + nmoves,
+                weigh);
         pieces &= ~lsb;
         lsb = pieces & -pieces;
     }
     return nmoves;
 }
 
+/*******************************************************************************
+ * Counts the legal moves of the side to move without building the move list.
+ * It skips the move ordering heuristics of gen_all_moves, which makes it the
+ * cheap choice when only the number of moves is wanted, as at perft leaves.
+ *
+ * @param board The board to count the moves on
+ * @return The number of legal moves, counting each promotion piece separately
+ ******************************************************************************/
+int count_legal_moves(Board* board)
+{
+    int color = board->to_move;
+    int nmoves = 0;
+    uint64_t pieces = (color == WHITE) ? board->all_white : board->all_black;
+    uint64_t src = pieces & -pieces;
+    while (src)
+    {
+        int piece;
+        uint64_t moves = gen_piece_moves(board, color, src, &piece);
+        uint64_t lsb = moves & -moves;
+        while (lsb)
+        {
+            Move move = {src, lsb, piece, color, -1};
+            if (is_legal(board, move))
+                nmoves += (piece == PAWN && (lsb & (RANK_1 | RANK_8))) ? 4 : 1;
+            moves &= ~lsb;
+            lsb = moves & -moves;
+        }
+        pieces &= ~src;
+        src = pieces & -pieces;
+    }
+    return nmoves;
+}
+
 /*******************************************************************************
  * Populates an array with all possible moves on the current board that attack
  * an enemy piece. It will only generate moves for the side that is indicated by
@@ -737,24 +845,13 @@ int gen_all_moves(Board* board, Cand* movearr)
  ******************************************************************************/
 int gen_all_attack_moves(Board* board, Cand* movearr)
 {
-    memset(movearr, 0, sizeof(Cand) * MOVES_PER_POSITION);
-    Cand cans[MOVES_PER_POSITION];
-    int num_moves = gen_all_moves(board, cans);
+    int num_moves = gen_all_moves(board, movearr);
     uint64_t pieces;
     if (board->to_move == WHITE)
         pieces = board->all_black;
     else
         pieces = board->all_white;
-    int num_attacks, i;
-    num_attacks = 0;
-    for (i = 0; i < num_moves; ++i) {
-        if (cans[i].move.dest & pieces)
-        {
-            memcpy(movearr + num_attacks, cans + i, sizeof(Cand));
-            num_attacks++;
-        }
-    }
-    return num_attacks;
+    return keep_attacks_on_square(movearr, num_moves, pieces);
 }
 
 /*******************************************************************************
@@ -769,275 +866,29 @@ int gen_all_attack_moves(Board* board, Cand* movearr)
  ******************************************************************************/
 int gen_all_attacks_on_square(Board* board, Cand* movearr, uint64_t square)
 {
-    memset(movearr, 0, sizeof(Cand) * MOVES_PER_POSITION);
-    Cand cans[MOVES_PER_POSITION];
-    int num_moves = gen_all_moves(board, cans);
-    int num_attacks, i;
-    num_attacks = 0;
-    for (i = 0; i < num_moves; ++i) {
-        if (cans[i].move.dest & square)
-        {
-            memcpy(movearr + num_attacks, cans + i, sizeof(Cand));
-            num_attacks++;
-        }
-    }
-    return num_attacks;
-}
-
-void remove_position(Board* board)
-{
-    position_hashes[board->hash % TABLE_SIZE]--;
-}
-int alphaBetaMin_attack(Board* board, Cand* cand, int alpha, int beta, int depth);
-int alphaBetaMax_attack(Board* board, Cand* cand, int alpha, int beta, int depth)
-{
-    Board temp_board;
-    memcpy(&temp_board, board, sizeof(Board));
-    move_piece(&temp_board, &cand->move);
-    if (is_stalemate(&temp_board, temp_board.to_move))
-        return 5;
-    if(is_checkmate(&temp_board, temp_board.to_move))
-        return (-300 + depth);
-    Cand cans[MOVES_PER_POSITION];
-    int num_moves = gen_all_attacks_on_square(&temp_board, cans, cand->move.dest);
-    if (!num_moves)
-    {
-        int bv = get_board_value(&temp_board);
-        return get_board_value(&temp_board);
-    }
-    int i;
-    int score;
-    for (i = 0; i < num_moves; ++i)
-    {
-        score = alphaBetaMin_attack(&temp_board, &cans[i], alpha, beta, depth + 1);
-        if (score >= beta)
-            return beta;
-        if (score > alpha)
-            alpha = score;
-    }
-    return alpha;
-}
-
-int alphaBetaMin_attack(Board* board, Cand* cand, int alpha, int beta, int depth)
-{
-    Board temp_board;
-    memcpy(&temp_board, board, sizeof(Board));
-    move_piece(&temp_board, &cand->move);
-    if (is_stalemate(&temp_board, temp_board.to_move))
-        return -5;
-    if(is_checkmate(&temp_board, temp_board.to_move))
-        return (300 - depth);
-    Cand cans[MOVES_PER_POSITION];
-    int num_moves = gen_all_attacks_on_square(&temp_board, cans, cand->move.dest);
-    if (!num_moves)
-    {
-        int bv = get_board_value(&temp_board);
-        return -bv;
-    }
-    int i;
-    int score;
-    for (i = 0; i < num_moves; ++i)
-    {
-        score = alphaBetaMax_attack(&temp_board, &cans[i], alpha, beta, depth + 1);
-        if (score <= alpha)
-            return alpha;
-        if (score < beta)
-            beta = score;
-    }
-    return beta;
-}
-
-int alphaBetaMin(Board* board, Cand* cand, int alpha, int beta, int depth, int startDepth);
-int alphaBetaMax(Board* board, Cand* cand, int alpha, int beta, int depth, int startDepth)
-{
-    Board temp_board;
-    memcpy(&temp_board, board, sizeof(Board));
-    move_piece(&temp_board, &cand->move);
-    add_position(&temp_board);
-    if (is_threefold(&temp_board))
-    {
-        remove_position(&temp_board);
-        return 5;
-    }
-    if (is_hashed(&temp_board, depth))
-    {
-        remove_position(&temp_board);
-        return get_hashed_value(&temp_board);
-    }
-    if (is_stalemate(&temp_board, temp_board.to_move))
-    {
-        remove_position(&temp_board);
-        return 5;
-    }
-    if(is_checkmate(&temp_board, temp_board.to_move))
-    {
-        remove_position(&temp_board);
-        return (-300 - depth);
-    }
-    if (!depth)
-    {
-        int bv = get_board_value(&temp_board);
-        set_hashed_value(&temp_board, bv, startDepth);
-        remove_position(&temp_board);
-        return get_board_value(&temp_board);
-    }
-    Cand cans[MOVES_PER_POSITION];
-    int num_moves = gen_all_moves(&temp_board, cans);
-    int i;
-    int score;
-    for (i = 0; i < num_moves; ++i)
-    {
-        score = alphaBetaMin(&temp_board, &cans[i], alpha, beta, depth - 1, startDepth);
-        if (score >= beta)
-        {
-            remove_position(&temp_board);
-            return beta;
-        }
-        if (score > alpha)
-            alpha = score;
-    }
-    remove_position(&temp_board);
-    return alpha;
-}
-
-int alphaBetaMin(Board* board, Cand* cand, int alpha, int beta, int depth, int startDepth)
-{
-    Board temp_board;
-    memcpy(&temp_board, board, sizeof(Board));
-    move_piece(&temp_board, &cand->move);
-    add_position(&temp_board);
-    if (is_threefold(&temp_board))
-    {
-        remove_position(&temp_board);
-        return -5;
-    }
-    if (is_hashed(&temp_board, depth))
-    {
-        remove_position(&temp_board);
-        return get_hashed_value(&temp_board);
-    }
-    if (is_stalemate(&temp_board, temp_board.to_move))
-    {
-        remove_position(&temp_board);
-        return 0;
-    }
-    if(is_checkmate(&temp_board, temp_board.to_move))
-    {
-        remove_position(&temp_board);
-        return (300 + depth);
-    }
-    if (!depth)
-    {
-        int bv = get_board_value(&temp_board);
-        set_hashed_value(&temp_board, bv, startDepth);
-        remove_position(&temp_board);
-        return bv;
-    }
-    Cand cans[MOVES_PER_POSITION];
-    int num_moves = gen_all_moves(&temp_board, cans);
-    int i;
-    int score;
-    for (i = 0; i < num_moves; ++i)
-    {
-        score = alphaBetaMax(&temp_board, &cans[i], alpha, beta, depth - 1, startDepth);
-        if (score <= alpha)
-        {
-            remove_position(&temp_board);
-            return alpha;
-        }
-        if (score < beta)
-            beta = score;
-    }
-    remove_position(&temp_board);
-    return beta;
+    int num_moves = gen_all_moves(board, movearr);
+    return keep_attacks_on_square(movearr, num_moves, square);
 }
 
 /*******************************************************************************
- * Minimax algo with alpha-beta pruning to find the best chess move.
+ * Filters an already generated list of moves down to the ones that land on
+ * one of the given squares, keeping their order
  *
- * @param board The board to find the best move for
- * @param cand The candidate move used to start the search. The candidate move 
- *             is made on a temporary board, then the best move among the 
- *             resulting board is found
- * @param alpha Used for alpha-beta pruning. It is the the highest value seen so
- *             far in the search.
- * @param beta Used for alpha-beta pruning. It is the lowest value seen so far
- *             in the search.
- * @param depth The depth to which the function should search
+ * @param cans The list of moves to filter in place
+ * @param num_moves The number of moves in the list
+ * @param square The squares the kept moves must land on
+ * @return The number of moves kept
  ******************************************************************************/
-int eval_prune(Board* board, Cand* cand, int alpha, int beta, int depth)
+int keep_attacks_on_square(Cand* cans, int num_moves, uint64_t square)
 {
-    Board temp_board;
-    memcpy(&temp_board, board, sizeof(Board));
-    move_piece(&temp_board, &cand->move);
-    if (is_threefold(&temp_board))
-        return 0;
-    if (is_hashed(&temp_board, depth))
-        return get_hashed_value(&temp_board);
-    if (is_stalemate(&temp_board, temp_board.to_move))
-        return 0;
-    if (depth == 0)
-    {
-        int bv = get_board_value(&temp_board);
-        //set_hashed_value(&temp_board, bv);
-        //current_line[0] = cand->move;
-        return bv;
-    }
-    else
+    int num_attacks = 0;
+    int i;
+    for (i = 0; i < num_moves; ++i)
     {
-        Cand cans[MOVES_PER_POSITION];
-        int num_moves = gen_all_moves(&temp_board, cans);
-        int i;
-        int board_value;
-        int temp = 0;
-        int broken = 0;
-        Move* bestmove = &cans[0].move;
-        if (temp_board.to_move == BLACK)
-            board_value = 300;
-        else
-            board_value = -300;
-        for (i = 0; i < num_moves; ++i)
-        {
-            if (cans[i].move.src == EMPTY)
-                break;
-            if (temp_board.to_move == BLACK)
-            {
-                temp = eval_prune(&temp_board,&cans[i], alpha, beta, depth - 1);
-                if (temp < board_value)
-                {
-                    board_value = temp;
-                    bestmove = &cans[i].move;
-                }
-                beta = (temp < beta) ? temp : beta;
-                if (beta <= alpha)
-                {
-                    broken = 1;
-                    //memset(current_line, 0, sizeof(Move) * depth);
-                    break;
-                }
-            }
-            else
-            {
-                temp = eval_prune(&temp_board,&cans[i], alpha, beta, depth - 1);
-                if (temp > board_value)
-                {
-                    board_value = temp;
-                    bestmove = &cans[i].move;
-                }
-                alpha = (temp > alpha) ? temp : alpha;
-                if (beta <= alpha)
-                {
-                    broken = 1;
-                    //memset(current_line, 0, sizeof(Move) * depth);
-                    break;
-                }
-            }
-        }
-        //if (!broken)
-            //set_hashed_value(&temp_board, board_value);
-        current_line[depth - 1] = *bestmove;
-        return board_value;
+        if (cans[i].move.dest & square)
+            cans[num_attacks++] = cans[i];
     }
+    return num_attacks;
 }
 
 /*******************************************************************************
@@ -1085,52 +936,70 @@ int get_board_value(Board* board)
 }
 
 /*******************************************************************************
- * Extracts all the moves from a bitboard and creates a Move struct for each of
- * them and puts them in the given array.
+ * Generates the pseudo-legal destinations of a single piece, whatever its type
  *
- * @param board The board to extract the moves from. It is used to verify that
- *              the move being extracted is legal.
- * @param color The color of the pieces that are making the moves
- * @param src The bitboard that contains the piece that will be making the moves
- * @param movearr The array of candidate moves to be filled with the extracted
- *                moves. It is guaranteed to be of length MOVES_PER_POSITION. 
+ * @param board The board the piece is on
+ * @param color The color of the piece
+ * @param src The bitboard that contains the piece
+ * @param piece Set to the type of the piece, or -1 if src is empty
+ * @return The bitboard of destinations
  ******************************************************************************/
-int extract_moves(Board* board, int color, uint64_t src, Cand* movearr)
+uint64_t gen_piece_moves(Board* board, int color, uint64_t src, int* piece)
 {
-    //printf("0x%016lX\n", src);
-    int count = 0;
-    int piece = -1;
-    uint64_t moves = EMPTY;
+    *piece = -1;
     if (src & board->pieces[color + PAWN])
     {
-        moves = gen_pawn_moves(board, color, src);
-        piece = PAWN;
+        *piece = PAWN;
+        return gen_pawn_moves(board, color, src);
     }
-    else if (src & board->pieces[color + BISHOP])
+    if (src & board->pieces[color + BISHOP])
     {
-        moves = gen_bishop_moves(board, color, src);
-        piece = BISHOP;
+        *piece = BISHOP;
+        return gen_bishop_moves(board, color, src);
     }
-    else if (src & board->pieces[color + KNIGHT])
+    if (src & board->pieces[color + KNIGHT])
     {
-        moves = gen_knight_moves(board, color, src);
-        piece = KNIGHT;
+        *piece = KNIGHT;
+        return gen_knight_moves(board, color, src);
     }
-    else if (src & board->pieces[color + ROOK])
+    if (src & board->pieces[color + ROOK])
     {
-        moves = gen_rook_moves(board, color, src);
-        piece = ROOK;
+        *piece = ROOK;
+        return gen_rook_moves(board, color, src);
     }
-    else if (src & board->pieces[color + QUEEN])
+    if (src & board->pieces[color + QUEEN])
     {
-        moves = gen_queen_moves(board, color, src);
-        piece = QUEEN;
+        *piece = QUEEN;
+        return gen_queen_moves(board, color, src);
     }
-    else if (src & board->pieces[color + KING])
+    if (src & board->pieces[color + KING])
     {
-        moves = gen_king_moves(board, color, src);
-        piece = KING;
+        *piece = KING;
+        return gen_king_moves(board, color, src);
     }
+    return EMPTY;
+}
+
+/*******************************************************************************
+ * Extracts all the moves from a bitboard and creates a Move struct for each of
+ * them and puts them in the given array.
+ *
+ * @param board The board to extract the moves from. It is used to verify that
+ *              the move being extracted is legal.
+ * @param color The color of the pieces that are making the moves
+ * @param src The bitboard that contains the piece that will be making the moves
+ * @param movearr The array of candidate moves to be filled with the extracted
+ *                moves. It is guaranteed to be of length MOVES_PER_POSITION. 
+ * @param weigh Whether to weigh the moves with apply_heuristics, otherwise
+ *              their weight is 0
+ ******************************************************************************/
+int extract_moves(Board* board, int color, uint64_t src, Cand* movearr,
+        int weigh)
+{
+    //printf("0x%016lX\n", src);
+    int count = 0;
+    int piece = -1;
+    uint64_t moves = gen_piece_moves(board, color, src, &piece);
     uint64_t lsb = moves & -moves;
     while (lsb)
     {
@@ -1140,7 +1009,12 @@ int extract_moves(Board* board, int color, uint64_t src, Cand* movearr)
         temp_move.piece = piece;
         temp_move.color = color;
         temp_move.promote = -1;
-        if (is_legal(board, temp_move))
+        STAT_TIMER_START(legal_start);
+        int legal = is_legal(board, temp_move);
+        STAT_TIMER_STOP(legal_start, PHASE_LEGALITY);
+        if (!legal)
+            STAT_INC(illegal_moves);
+        else
         {
             if (piece == PAWN && (lsb & (RANK_1 | RANK_8)))
             {
@@ -1152,8 +1026,9 @@ int extract_moves(Board* board, int color, uint64_t src, Cand* movearr)
                     movearr[count].move.piece = piece;
                     movearr[count].move.color = color;
                     movearr[count].move.promote = i;
-                    movearr[count].weight = 1;
-                    apply_heuristics(board, movearr + count);
+                    movearr[count].weight = weigh;
+                    if (weigh)
+                        apply_heuristics(board, movearr + count);
                     count++;
 
                 }
@@ -1165,8 +1040,9 @@ int extract_moves(Board* board, int color, uint64_t src, Cand* movearr)
                 movearr[count].move.piece = piece;
                 movearr[count].move.color = color;
                 movearr[count].move.promote = -1;
-                movearr[count].weight = 1;
-                apply_heuristics(board, movearr + count);
+                movearr[count].weight = weigh;
+                if (weigh)
+                    apply_heuristics(board, movearr + count);
                 count++;
             }
         }
@@ -1189,6 +1065,11 @@ int is_legal(Board* board, Move move)
     memcpy(&temp, board, sizeof(Board));
     move_piece(&temp, &move);
     uint64_t all_attacks;
+    /* Pawns only count as attacking occupied squares, so a pawn checking the
+     * king is no longer seen once the king has castled away from it */
+    if (move.piece == KING && (move.dest & board->castle) &&
+            is_in_check(board, board->to_move))
+        return 0;
     if(board->to_move == WHITE)
     {
         all_attacks = gen_all_dests(&temp, BLACK);
@@ -1213,105 +1094,6 @@ int is_legal(Board* board, Move move)
     }
 }
 
-/*******************************************************************************
- * Returns the best move to make in a given position when searched at a given
- * depth
- *
- * @param board The board to search for the best move
- * @param depth The depth at which to search the board
- * @param time  The time left on the clock in msec
- ******************************************************************************/
-Move find_best_move(Board* board, int depth, int time)
-{
-    Cand cands[MOVES_PER_POSITION];
-    Cand bestmove;
-    bestmove.weight = -9001;
-    int num_attack_moves = gen_all_attack_moves(board, cands);
-    int i;
-    for (i = 0; i < num_attack_moves; ++i)
-    {
-        if (cands[i].move.src == EMPTY)
-            break;
-        int temp_weight = 0;
-        temp_weight = -alphaBetaMax_attack(board, &cands[i], -300, 300, 0);
-        cands[i].weight = temp_weight;
-        print_move(2, &cands[i].move);
-        char s[100];
-        sprintf(s, " attack weight: %d ", cands[i].weight);
-        if(write(2, s, strlen(s)) == -1)
-            perror("from find_best_move");
-        int m;
-        if(write(2, "\n", 1) == -1)
-            perror("from find_best_move");
-        if (cands[i].weight > bestmove.weight)
-            bestmove = cands[i];
-    }
-    int bv = get_board_value(board);
-    if (bv < 0)
-        bv *= -1;
-    if (bestmove.weight > bv)
-        return bestmove.move;
-
-    if (time < 60000 && time >= 0)
-        depth--;
-    int num_moves = gen_all_moves(board, cands);
-    qsort(cands, MOVES_PER_POSITION, sizeof(Cand), comp_cand);
-    int j;
-    for (j = 1; j <= depth; ++j)
-    {
-        //zobrist_clear();
-        for (i = 0; i < num_moves; ++i)
-        {
-            if (cands[i].move.src == EMPTY)
-                break;
-            //int temp_weight = eval_prune(board, &cands[i], -300, 300, j - 1);
-            //int temp_weight = alphaBetaMax(board, &cands[i], -300, 300, j - 1);
-            int temp_weight = 0;
-            //if (board->to_move == WHITE)
-            //temp_weight = alphaBetaMin(board, &cands[i], -300, 300, j - 1);
-            //else 
-            temp_weight = -alphaBetaMax(board, &cands[i], -300, 300, j - 1,
-                    j - 1);
-            cands[i].weight = temp_weight;
-            if (j == depth)
-            {
-                //current_line[j] = cands[i].move;
-                print_move(2, &cands[i].move);
-                char s[100];
-                sprintf(s, " weight: %d ", cands[i].weight);
-                if(write(2, s, strlen(s)) == -1)
-                    perror("from find_best_move");
-                int m;
-                for (m = LINE_LENGTH - 1; m >= 0; --m)
-                {
-                    if (current_line[m].src)
-                    {
-                        print_move(2, &current_line[m]);
-                        if(write(2, " ", 1) == -1)
-                            perror("from find_best_move");
-                    }
-                }
-                if(write(2, "\n", 1) == -1)
-                    perror("from find_best_move");
-                memset(current_line, 0, sizeof(Move) * LINE_LENGTH);
-                if (cands[i].weight > bestmove.weight)
-                    bestmove = cands[i];
-            }
-        }
-        qsort(cands, num_moves, sizeof(Cand), comp_cand);
-    }
-    for (i = 0; i < num_moves; ++i)
-    {
-        if (cands[i].weight != bestmove.weight)
-            break;
-    }
-    if (i - 1 != 0)
-        bestmove = cands[rand() % (i - 1)];
-    else
-        bestmove = cands[0];
-    return bestmove.move;
-}
-
 /*******************************************************************************
  * Gives a move a weight based on the following heuristics:
  * Is the square the piece is moving to worth more than itself?
@@ -1377,6 +1159,98 @@ int get_piece_value(Board* board, int color, uint64_t piece)
     return 0;
 }
 
+/*******************************************************************************
+ * Finds the least valuable piece of the side to move that attacks a square.
+ * Pins are ignored, so the returned capture may not be legal.
+ *
+ * @param board The board to look for attackers on
+ * @param square The square that is being attacked
+ * @param move Filled with the capture by the least valuable attacker
+ * @return 1 if an attacker was found, 0 otherwise
+ ******************************************************************************/
+int least_valuable_attacker(Board* board, uint64_t square, Move* move)
+{
+    int color = board->to_move;
+    int i;
+    for (i = PAWN; i <= KING; ++i)
+    {
+        uint64_t src = board->pieces[color + i];
+        uint64_t lsb = src & -src;
+        while (lsb)
+        {
+            uint64_t moves = EMPTY;
+            if (i == PAWN)
+                moves = gen_pawn_moves(board, color, lsb);
+            else if (i == BISHOP)
+                moves = gen_bishop_moves(board, color, lsb);
+            else if (i == KNIGHT)
+                moves = gen_knight_moves(board, color, lsb);
+            else if (i == ROOK)
+                moves = gen_rook_moves(board, color, lsb);
+            else if (i == QUEEN)
+                moves = gen_queen_moves(board, color, lsb);
+            else
+                moves = gen_king_moves(board, color, lsb);
+            if (moves & square)
+            {
+                move->src = lsb;
+                move->dest = square;
+                move->piece = i;
+                move->color = color;
+                move->promote = (i == PAWN && (square & (RANK_1 | RANK_8))) ?
+                    QUEEN : -1;
+                return 1;
+            }
+            src &= ~lsb;
+            lsb = src & -src;
+        }
+    }
+    return 0;
+}
+
+/*******************************************************************************
+ * Returns the material the side to move wins by starting a sequence of
+ * captures on a square, always recapturing with the least valuable attacker
+ * and stopping whenever continuing would lose material
+ ******************************************************************************/
+int see_square(Board* board, uint64_t square)
+{
+    Move move;
+    if (!least_valuable_attacker(board, square, &move))
+        return 0;
+    int ecolor = (board->to_move == BLACK) ? WHITE : BLACK;
+    int captured = get_piece_value(board, ecolor, square);
+    if (board->pieces[ecolor + KING] & square)
+        captured = see_values[KING];
+    Board temp;
+    memcpy(&temp, board, sizeof(Board));
+    move_piece(&temp, &move);
+    int gain = captured - see_square(&temp, square);
+    return (gain > 0) ? gain : 0;
+}
+
+/*******************************************************************************
+ * Static exchange evaluation of a move. Returns the material balance in pawns
+ * for the side making the move once all profitable recaptures on the
+ * destination square have been played out
+ *
+ * @param board The board to make the move on
+ * @param move The move to evaluate
+ ******************************************************************************/
+int see(Board* board, Move* move)
+{
+    int ecolor = (move->color == BLACK) ? WHITE : BLACK;
+    int gain = get_piece_value(board, ecolor, move->dest);
+    if (move->piece == PAWN && (move->dest & board->en_p))
+        gain = 1;
+    if (move->promote != -1)
+        gain += see_values[move->promote] - see_values[PAWN];
+    Board temp;
+    memcpy(&temp, board, sizeof(Board));
+    move_piece(&temp, move);
+    return gain - see_square(&temp, move->dest);
+}
+
 /*******************************************************************************
  * Checks if the current boardstate is checkmate for the given color
  *
@@ -1449,6 +1323,18 @@ int is_checkmate(Board* board, int color)
     return 1;
 }
 
+/*******************************************************************************
+ * Checks if the king of the given color is currently attacked
+ *
+ * @param board The board to check
+ * @param color The color of the king to check
+ ******************************************************************************/
+int is_in_check(Board* board, int color)
+{
+    int ecolor = (color == BLACK) ? WHITE : BLACK;
+    return (board->pieces[KING + color] & gen_all_dests(board, ecolor)) != 0;
+}
+
 /*******************************************************************************
  * Checks if making a move will result in checkmate
  *
@@ -1528,125 +1414,162 @@ int is_stalemate(Board* board, int color)
 }
 
 /*******************************************************************************
- * Perft function to find the node count of a certain depth
- *
- * @param board The board to calculate for
- * @param depth The depth at which to search
- * @return the number of nodes found
+ * Fills the table of squares between two squares on a rank, file or diagonal
  ******************************************************************************/
-Pres perft(Board* board, int depth)
+void board_init()
 {
-    uint64_t nodes = 0;
-    Pres pres;
-    memset(&pres, 0, sizeof(Pres));
-    Cand cans[MOVES_PER_POSITION];
-    int num_moves = gen_all_moves(board, cans);
-    int i;
-    for (i = 0; i < num_moves; ++i)
+    int a, d;
+    const int dirs[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1},
+                            {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+    memset(between_squares, 0, sizeof(between_squares));
+    for (a = 0; a < 64; ++a)
     {
-        if (cans[i].move.src == EMPTY)
-            break;
-        Board temp_board;
-        memcpy(&temp_board, board, sizeof(Board));
-        move_piece(&temp_board, &cans[i].move);
-        get_nodes(board, &(cans[i]), depth - 1, &pres);
+        for (d = 0; d < 8; ++d)
+        {
+            uint64_t squares = EMPTY;
+            int file = a % 8 + dirs[d][0];
+            int rank = a / 8 + dirs[d][1];
+            while (file >= 0 && file < 8 && rank >= 0 && rank < 8)
+            {
+                between_squares[a][rank * 8 + file] = squares;
+                squares |= 0x1ULL << (rank * 8 + file);
+                file += dirs[d][0];
+                rank += dirs[d][1];
+            }
+        }
     }
-    return pres;
 }
 
 /*******************************************************************************
- * Recursive function that implements Perft function
+ * Empties the list of positions used for repetition detection
  ******************************************************************************/
-void get_nodes(Board* board, Cand* cand, int depth, Pres* pres)
+void clear_positions()
 {
-    Board temp_board;
-    memcpy(&temp_board, board, sizeof(Board));
-    if (depth == 0)
+    num_positions = 0;
+}
+
+/*******************************************************************************
+ * Pushes the board's position onto the list of positions of the game and the
+ * current search line. Positions past MAX_GAME_PLY are counted but not stored.
+ *
+ * @param board The board whose position was just reached
+ ******************************************************************************/
+void add_position(Board* board)
+{
+    if (num_positions < MAX_GAME_PLY)
+        position_keys[num_positions] = board->hash;
+    num_positions++;
+}
+
+/*******************************************************************************
+ * Pops the most recent position off the list of positions
+ ******************************************************************************/
+void remove_position()
+{
+    num_positions--;
+}
+
+/*******************************************************************************
+ * Checks whether the board's position, which must be the last one added, has
+ * occurred before. Only positions with the same side to move since the last
+ * irreversible move can match, so the scan goes back two plies at a time and
+ * stops after board->halfmove plies.
+ *
+ * @param board The board to check
+ * @return 1 if the position is a repetition, 0 otherwise
+ ******************************************************************************/
+int is_threefold(Board* board)
+{
+    int last = num_positions - 1;
+    int i;
+    for (i = 4; i <= board->halfmove && last - i >= 0; i += 2)
     {
-        if (board->to_move == BLACK && (board->all_white & cand->move.dest))
-            pres->caps++;
-        else if (board->to_move == WHITE && (board->all_black & cand->move.dest))
-            pres->caps++;
-        if ((board->en_p & cand->move.dest) && cand->move.piece == PAWN)
-        {
-            pres->caps++;
-            pres->eps++;
-        }
-        if (cand->move.piece == KING && cand->move.color == WHITE)
-        {
-            if ((cand->move.src & 0x8ULL) && (cand->move.dest & 0x22ULL))
-            {
-                pres->castles++;
-                //print_board(&temp_board);
-            }
-        }
-        if (cand->move.piece == KING && cand->move.color == BLACK)
-        {
-            if ((cand->move.src & (0x8ULL << 56)) && (cand->move.dest &
-                        (0x22ULL << 56)))
-            {
-                pres->castles++;
-                //print_board(&temp_board);
-            }
-        }
-        if (cand->move.promote != -1)
-            pres->proms++;
-        pres->nodes++;
+        if (last - i < MAX_GAME_PLY && position_keys[last - i] == board->hash)
+            return 1;
     }
-    move_piece(&temp_board, &cand->move);
-    if (depth == 0)
-    {
-        if (temp_board.to_move == BLACK && (temp_board.pieces[BLACK + KING] &
-                    gen_all_dests(&temp_board, WHITE)))
-            pres->checks++;
-        if (temp_board.to_move == WHITE && (temp_board.pieces[WHITE + KING] &
-                    gen_all_dests(&temp_board, BLACK)))
-            pres->checks++;
-        if (is_checkmate(&temp_board, temp_board.to_move))
-        {
-            pres->checkmates++;
-            //print_board(&temp_board);
-        }
-        if (cand->move.piece == KING && cand->move.color == WHITE)
-        {
-            if ((cand->move.src & 0x8ULL) && (cand->move.dest & 0x22ULL))
-            {
-                //print_board(&temp_board);
-            }
-        }
-        if (cand->move.piece == KING && cand->move.color == BLACK)
-        {
-            if ((cand->move.src & (0x8ULL << 56)) && (cand->move.dest &
-                        (0x22ULL << 56)))
-            {
-                //print_board(&temp_board);
-            }
-        }
+    return 0;
+}
 
-        return;
-    }
-    Cand cans[MOVES_PER_POSITION];
-    int num_moves = gen_all_moves(&temp_board, cans);
+/*******************************************************************************
+ * Counts how often the board's position, which must be the last one added,
+ * occurred before in the game and the current search line
+ *
+ * @param board The board to check
+ * @return The number of earlier occurrences
+ ******************************************************************************/
+int repetition_count(Board* board)
+{
+    int last = num_positions - 1;
+    int count = 0;
     int i;
-    for (i = 0; i < num_moves; ++i)
+    for (i = 4; i <= board->halfmove && last - i >= 0; i += 2)
     {
-        if (cans[i].move.src == EMPTY)
-            break;
-        get_nodes(&temp_board, &(cans[i]), depth - 1, pres);
+        if (last - i < MAX_GAME_PLY && position_keys[last - i] == board->hash)
+            count++;
     }
+    return count;
 }
 
-void add_position(Board* board)
+/*******************************************************************************
+ * Checks whether neither side has the material left to deliver mate. This
+ * covers bare kings, a single minor piece against a bare king, and bishops
+ * only, all on squares of the same color.
+ *
+ * @param board The board to check
+ * @return 1 if the position is a dead draw, 0 otherwise
+ ******************************************************************************/
+int is_material_draw(Board* board)
 {
-    position_hashes[board->hash % TABLE_SIZE]++;
+    const uint64_t light_squares = 0xAA55AA55AA55AA55ULL;
+    if (board->pieces[WHITE + PAWN] | board->pieces[BLACK + PAWN] |
+        board->pieces[WHITE + ROOK] | board->pieces[BLACK + ROOK] |
+        board->pieces[WHITE + QUEEN] | board->pieces[BLACK + QUEEN])
+        return 0;
+    uint64_t knights = board->pieces[WHITE + KNIGHT] |
+        board->pieces[BLACK + KNIGHT];
+    uint64_t bishops = board->pieces[WHITE + BISHOP] |
+        board->pieces[BLACK + BISHOP];
+    int minors = __builtin_popcountll(knights | bishops);
+    if (minors <= 1)
+        return 1;
+    if (knights)
+        return 0;
+    return !(bishops & light_squares) || !(bishops & ~light_squares);
 }
 
-int is_threefold(Board* board)
+/*******************************************************************************
+ * Checks whether the side to move has a move that repeats a position of the
+ * current search line. The key difference to each earlier position is looked
+ * up in the cuckoo table of reversible piece moves; if one matches, the piece
+ * that would make it belongs to the side to move and the path of that move is
+ * clear, the repetition is available.
+ *
+ * @param board The board to check, which must be the last position added
+ * @param ply The distance from the root of the search
+ * @return 1 if a repetition can be forced, 0 otherwise
+ ******************************************************************************/
+int has_game_cycle(Board* board, int ply)
 {
-    if (position_hashes[board->hash % TABLE_SIZE] >= 2)
-    {
-        //printf("Found a match!\n");
-        return 1;
+    int last = num_positions - 1;
+    uint64_t occupied = board->all_white | board->all_black;
+    uint64_t own = (board->to_move == WHITE) ? board->all_white :
+        board->all_black;
+    int i;
+    /* Positions before the root need a real repetition, not just a cycle */
+    for (i = 3; i <= board->halfmove && i < ply && last - i >= 0; i += 2)
+    {
+        if (last - i >= MAX_GAME_PLY)
+            continue;
+        int src, dest;
+        if (!cuckoo_lookup(board->hash ^ position_keys[last - i], &src, &dest))
+            continue;
+        /* The table holds both directions of a move under one key, so the
+         * piece is on whichever of the two squares is occupied */
+        uint64_t squares = (0x1ULL << src) | (0x1ULL << dest);
+        if (!(squares & own))
+            continue;
+        if (!(between_squares[src][dest] & occupied))
+            return 1;
     }
     return 0;
 }
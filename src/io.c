@@ -1,9 +1,11 @@
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include "board.h"
 #include "io.h"
+#include "zobrist.h"
 
 uint64_t square_to_bit(char* square)
 {
@@ -29,6 +31,46 @@ void find_piece(Board* board, Move* move)
     }
 }
 
+/*******************************************************************************
+ * Reads a move in UCI notation, such as e2e4 or e7e8q
+ *
+ * @param board The board the move is played on
+ * @param str The move in UCI notation
+ * @param move The move to fill in
+ ******************************************************************************/
+void parse_move(Board* board, char* str, Move* move)
+{
+    move->src = square_to_bit(str);
+    move->dest = square_to_bit(str + 2);
+    find_piece(board, move);
+    move->promote = -1;
+    switch (str[4])
+    {
+        case 'b':
+            move->promote = BISHOP;
+            break;
+        case 'n':
+            move->promote = KNIGHT;
+            break;
+        case 'r':
+            move->promote = ROOK;
+            break;
+        case 'q':
+            move->promote = QUEEN;
+            break;
+    }
+}
+
+/*******************************************************************************
+ * Checks whether a string looks like a move in UCI notation
+ ******************************************************************************/
+int is_move_string(char* str)
+{
+    return strlen(str) >= 4 && str[0] >= 'a' && str[0] <= 'h' &&
+        str[1] >= '1' && str[1] <= '8' && str[2] >= 'a' && str[2] <= 'h' &&
+        str[3] >= '1' && str[3] <= '8';
+}
+
 void print_location(int fd, uint64_t board)
 {
     int square = 63 - bitScanForward(board);
@@ -64,6 +106,85 @@ void print_move(int fd, Move* move)
     }
 }
 
+/*******************************************************************************
+ * Prepares an output buffer for writing to a file descriptor
+ *
+ * @param out The buffer to prepare
+ * @param fd The file descriptor the buffer is flushed to
+ ******************************************************************************/
+void buf_init(OutBuffer* out, int fd)
+{
+    out->fd = fd;
+    out->len = 0;
+}
+
+/*******************************************************************************
+ * Appends printf style formatted text to an output buffer, flushing it first
+ * if the text would not fit
+ *
+ * @param out The buffer to append to
+ * @param format The printf format string
+ ******************************************************************************/
+void buf_printf(OutBuffer* out, char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(out->data + out->len, OUT_BUFFER_SIZE - out->len,
+            format, args);
+    va_end(args);
+    if (len >= OUT_BUFFER_SIZE - out->len && out->len)
+    {
+        buf_flush(out);
+        va_start(args, format);
+        len = vsnprintf(out->data, OUT_BUFFER_SIZE, format, args);
+        va_end(args);
+    }
+    out->len += len;
+    if (out->len >= OUT_BUFFER_SIZE)
+        out->len = OUT_BUFFER_SIZE - 1;
+}
+
+/*******************************************************************************
+ * Appends a move in UCI long algebraic notation to an output buffer
+ *
+ * @param out The buffer to append to
+ * @param move The move to append
+ ******************************************************************************/
+void buf_move(OutBuffer* out, Move* move)
+{
+    /* UCI null move, sent as the best move when there are no legal moves */
+    if (!move->src)
+    {
+        buf_printf(out, "0000");
+        return;
+    }
+    int src = 63 - bitScanForward(move->src);
+    int dest = 63 - bitScanForward(move->dest);
+    char promote[2] = {0, 0};
+    if (move->promote == BISHOP)
+        promote[0] = 'b';
+    else if (move->promote == KNIGHT)
+        promote[0] = 'n';
+    else if (move->promote == ROOK)
+        promote[0] = 'r';
+    else if (move->promote == QUEEN)
+        promote[0] = 'q';
+    buf_printf(out, "%c%d%c%d%s", src % 8 + 'a', 8 - src / 8, dest % 8 + 'a',
+            8 - dest / 8, promote);
+}
+
+/*******************************************************************************
+ * Writes out everything collected in an output buffer
+ *
+ * @param out The buffer to flush
+ ******************************************************************************/
+void buf_flush(OutBuffer* out)
+{
+    if (out->len && write(out->fd, out->data, out->len) == -1)
+        perror("from buf_flush");
+    out->len = 0;
+}
+
 void print_board(Board* board)
 {
     int i;
@@ -175,7 +296,21 @@ void load_fen(Board* board, char* fen)
     else
         board->en_p = 0x01ULL << (63 - ((token[0] - 'a') + 
                     ('8' - token[1]) * 8));
+
+    /* The move counters are optional in many FENs sent by GUIs */
+    board->fullmove = 1;
+    token = strtok(NULL, " ");
+    if (token)
+    {
+        board->halfmove = atoi(token);
+        token = strtok(NULL, " ");
+        if (token && atoi(token) > 0)
+            board->fullmove = atoi(token);
+    }
     update_combined_pos(board);
+    board->hash = hash_position(board);
+    clear_positions();
+    add_position(board);
     free(fen_copy);
 }
 
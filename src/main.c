@@ -8,19 +8,97 @@
 
 *******************************************************************************/
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <time.h>
+#include <pthread.h>
 #include "board.h"
 #include "io.h"
 #include "zobrist.h"
+#include "search.h"
+#include "timeman.h"
+#include "bench.h"
+#include "perft.h"
+#include "stats.h"
+#include "trace.h"
 
-int main()
+typedef struct
+{
+    Board board;
+    SearchLimits limits;
+} SearchJob;
+
+SearchJob job;
+pthread_t search_thread;
+int search_running = 0;
+
+/*******************************************************************************
+ * Entry point of the search thread. Searches the job's position and prints
+ * the best move, and the reply to ponder on, once the search is over.
+ *
+ * @param arg The SearchJob to run
+ ******************************************************************************/
+void* search_worker(void* arg)
+{
+    SearchJob* search_job = (SearchJob*)arg;
+    long t = get_time_ms();
+    Move ponder;
+    Move bestmove = find_best_move(&search_job->board, &search_job->limits,
+            &ponder);
+    /* Infinite and ponder searches may only report their move after a stop
+     * or ponderhit command */
+    while ((search_job->limits.infinite || pondering) && !stop_search)
+        usleep(1000);
+    OutBuffer out;
+    buf_init(&out, 1);
+    if (debug_mode && STATS_ENABLED)
+        stats_print();
+    if (debug_mode)
+        buf_printf(&out, "info string time taken %.3f seconds\n",
+                (double)(get_time_ms() - t) / 1000);
+    buf_printf(&out, "bestmove ");
+    buf_move(&out, &bestmove);
+    if (ponder.src)
+    {
+        buf_printf(&out, " ponder ");
+        buf_move(&out, &ponder);
+    }
+    buf_printf(&out, "\n");
+    buf_flush(&out);
+    trace_flush(nodes);
+    return NULL;
+}
+
+/*******************************************************************************
+ * Stops the running search, if there is one, and waits for the search thread
+ * to print its best move and exit
+ ******************************************************************************/
+void stop_search_thread()
+{
+    if (!search_running)
+        return;
+    stop_search = 1;
+    pthread_join(search_thread, NULL);
+    search_running = 0;
+}
+
+int main(int argc, char** argv)
 {
     srand(12345);
+    board_init();
     zobrist_init();
+    search_init();
+    /* leape bench [depth] [threads] [hash] runs the benchmark and exits */
+    if (argc > 1 && !strcmp(argv[1], "bench"))
+    {
+        bench(argc > 2 ? atoi(argv[2]) : 0, argc > 3 ? atoi(argv[3]) : 0,
+                argc > 4 ? atoi(argv[4]) : 0);
+        return 0;
+    }
+    zobrist_resize(DEFAULT_HASH_MB);
     srand(time(0));
     int running = 1;
     FILE* input = fdopen(0, "r");
@@ -41,9 +119,23 @@ int main()
         char* token = strtok_r(message, "\n", &saveptr);
         if(!strcmp(token, "uci"))
         {
-            char* s = "id name Leape 1.1\nid author Hayden Johnson\nuciok\n";
+            char* s = "id name Leape 1.1\nid author Hayden Johnson\n";
+            if (write(1, s, strlen(s)) == -1)
+                perror("from main");
+            s = "option name Ponder type check default false\n";
+            if (write(1, s, strlen(s)) == -1)
+                perror("from main");
+            char hash_option[100];
+            sprintf(hash_option, "option name Hash type spin default %d min 1 "
+                    "max %d\n", DEFAULT_HASH_MB, MAX_HASH_MB);
+            if (write(1, hash_option, strlen(hash_option)) == -1)
+                perror("from main");
+            s = "option name TraceFile type string default <empty>\n";
             if (write(1, s, strlen(s)) == -1)
                 perror("from main");
+            print_search_params(1);
+            if (write(1, "uciok\n", 6) == -1)
+                perror("from main");
         }
         else if (!strcmp(token, "isready"))
         {
@@ -55,16 +147,25 @@ int main()
             token = strtok_r(message, " ", &saveptr);
         if (token && !strcmp(token, "position"))
         {
+            stop_search_thread();
             token = strtok_r(NULL, " ", &saveptr);
             if (token && !strcmp(token, "fen"))
             {
-                token = strtok_r(NULL, "\n", &saveptr);
-                load_fen(&board, token);
+                /* The FEN runs up to the moves keyword, if there is one */
+                char* fen = saveptr;
+                char* moves = strstr(fen, " moves");
+                if (moves)
+                {
+                    *moves = '\0';
+                    saveptr = moves + 1;
+                }
+                else
+                    saveptr = fen + strlen(fen);
+                load_fen(&board, fen);
             }
             if (token && !strcmp(token, "startpos"))
             {
                 set_default(&board);
-                add_position(&board);
             }
             token = strtok_r(NULL, " ", &saveptr);
             if (token && !strcmp(token, "moves"))
@@ -73,28 +174,7 @@ int main()
                 while (token)
                 {
                     Move move;
-                    move.src = square_to_bit(token);
-                    move.dest = square_to_bit(token + 2);
-                    find_piece(&board, &move);
-                    move.promote = -1;
-                    if (token[4] != '\n')
-                    {
-                        switch (token[4])
-                        {
-                            case 'b':
-                                move.promote = BISHOP;
-                                break;
-                            case 'n':
-                                move.promote = KNIGHT;
-                                break;
-                            case 'r':
-                                move.promote = ROOK;
-                                break;
-                            case 'q':
-                                move.promote = QUEEN;
-                                break;
-                        }
-                    }
+                    parse_move(&board, token, &move);
                     move_piece(&board, &move);
                     add_position(&board);
                     token = strtok_r(NULL, " ", &saveptr);
@@ -103,78 +183,129 @@ int main()
         }
         else if (!strcmp(token, "go"))
         {
-            int depth = -1;
-            int wtime = -1;
-            int btime = -1;
+            SearchLimits limits;
+            clear_limits(&limits);
             token = strtok_r(NULL, " ", &saveptr);
             while (token)
             {
-                if (!strcmp(token, "depth"))
-                {
-                    token = strtok_r(NULL, " ", &saveptr);
-                    depth = atoi(token);
-                }
-                else if (!strcmp(token, "wtime"))
+                if (!strcmp(token, "infinite"))
+                    limits.infinite = 1;
+                else if (!strcmp(token, "ponder"))
+                    limits.ponder = 1;
+                else if (!strcmp(token, "searchmoves"))
                 {
                     token = strtok_r(NULL, " ", &saveptr);
-                    wtime = atoi(token);
+                    while (token && is_move_string(token) &&
+                            limits.num_searchmoves < MOVES_PER_POSITION)
+                    {
+                        Move move;
+                        parse_move(&board, token, &move);
+                        limits.searchmoves[limits.num_searchmoves++] =
+                            pack_move(&move);
+                        token = strtok_r(NULL, " ", &saveptr);
+                    }
+                    continue;
                 }
-                else if (!strcmp(token, "btime"))
+                else
                 {
-                    token = strtok_r(NULL, " ", &saveptr);
-                    btime = atoi(token);
+                    char* value = strtok_r(NULL, " ", &saveptr);
+                    if (!value)
+                        break;
+                    if (!strcmp(token, "depth"))
+                        limits.depth = atoi(value);
+                    else if (!strcmp(token, "wtime"))
+                        limits.wtime = atoi(value);
+                    else if (!strcmp(token, "btime"))
+                        limits.btime = atoi(value);
+                    else if (!strcmp(token, "winc"))
+                        limits.winc = atoi(value);
+                    else if (!strcmp(token, "binc"))
+                        limits.binc = atoi(value);
+                    else if (!strcmp(token, "movestogo"))
+                        limits.movestogo = atoi(value);
+                    else if (!strcmp(token, "movetime"))
+                        limits.movetime = atoi(value);
+                    else if (!strcmp(token, "nodes"))
+                        limits.nodes = strtoull(value, NULL, 10);
                 }
                 token = strtok_r(NULL, " ", &saveptr);
             }
-            //printf("depth: %d, wtime: %d, btime: %d\n", depth, wtime, btime);
-            int time_left = btime;
-            if (board.to_move == WHITE)
-                time_left = wtime;
 
-            struct timeval timecheck;
-            long t;
-            gettimeofday(&timecheck, NULL);
-            t = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec /
-                1000;
-            Move bestmove = find_best_move(&board, depth, time_left);
-            gettimeofday(&timecheck, NULL);
-            t = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec / 1000 - t;
-            double time_taken = (double)t / 1000;
-            char s[100];
-            sprintf(s, "Time taken: %.6f seconds\n", time_taken);
-            if(write(2, s, strlen(s)) == -1)
+            stop_search_thread();
+            memcpy(&job.board, &board, sizeof(Board));
+            job.limits = limits;
+            stop_search = 0;
+            pondering = limits.ponder;
+            if (pthread_create(&search_thread, NULL, search_worker, &job))
                 perror("from main");
-            if(write(1, "bestmove ", 9) == -1)
-                perror("from main");
-            print_location(1, bestmove.src);
-            print_location(1, bestmove.dest);
-            if (bestmove.promote == BISHOP)
-            {
-                if(write(1, "b", 1) == -1)
-                    perror("from main");
-            }
-            else if (bestmove.promote == KNIGHT)
-            {
-                if(write(1, "n", 1) == -1)
-                    perror("from main");
-            }
-            else if (bestmove.promote == ROOK)
+            else
+                search_running = 1;
+        }
+        else if (!strcmp(token, "debug"))
+        {
+            token = strtok_r(NULL, " ", &saveptr);
+            debug_mode = token && !strcmp(token, "on");
+        }
+        else if (!strcmp(token, "stop"))
+        {
+            stop_search_thread();
+        }
+        else if (!strcmp(token, "ponderhit"))
+        {
+            if (search_running && pondering)
+                ponderhit(&job.limits, job.board.to_move);
+        }
+        else if (!strcmp(token, "setoption"))
+        {
+            char* name = NULL;
+            char* value = NULL;
+            token = strtok_r(NULL, " ", &saveptr);
+            while (token)
             {
-                if(write(1, "r", 1) == -1)
-                    perror("from main");
+                if (!strcmp(token, "name"))
+                    name = strtok_r(NULL, " ", &saveptr);
+                else if (!strcmp(token, "value"))
+                    value = strtok_r(NULL, " ", &saveptr);
+                token = strtok_r(NULL, " ", &saveptr);
             }
-            else if (bestmove.promote == QUEEN)
+            stop_search_thread();
+            if (name && !strcasecmp(name, "TraceFile"))
+                trace_enable(value);
+            else if (name && value && !strcasecmp(name, "Hash"))
             {
-                if(write(1, "q", 1) == -1)
-                    perror("from main");
+                int mb = atoi(value);
+                zobrist_resize(mb < MAX_HASH_MB ? mb : MAX_HASH_MB);
             }
-            if(write(1, "\n", 1) == -1)
-                perror("from main");
+            else if (name && value)
+                set_search_param(name, atoi(value));
         }
         else if (!strcmp(token, "quit"))
         {
+            stop_search_thread();
             running = 0;
         }
+        else if (!strcmp(token, "stats"))
+            stats_print();
+        else if (!strcmp(token, "bench"))
+        {
+            int args[3] = {0, 0, 0};
+            int i;
+            for (i = 0; i < 3; ++i)
+            {
+                token = strtok_r(NULL, " ", &saveptr);
+                if (!token)
+                    break;
+                args[i] = atoi(token);
+            }
+            stop_search_thread();
+            bench(args[0], args[1], args[2]);
+        }
+        else if (!strcmp(token, "ucinewgame"))
+        {
+            stop_search_thread();
+            zobrist_clear();
+            search_clear();
+        }
         else if (!strcmp(token, "printboard"))
         {
             print_board(&board);
@@ -182,12 +313,85 @@ int main()
         else if (!strcmp(token, "perft"))
         {
             token = strtok_r(NULL, " ", &saveptr);
-            int depth = atoi(token);
-            Pres pres = perft(&board, depth);
-            printf("%ld nodes at %d depth\n", pres.nodes, depth);
-            printf("%ld captures, %ld en pessants\n", pres.caps, pres.eps);
-            printf("%ld checks, %ld checkmates\n", pres.checks, pres.checkmates);
-            printf("%ld castles, %ld promotions\n", pres.castles, pres.proms);
+            if (token && !strcmp(token, "suite"))
+            {
+                /* perft suite [max depth] [epd file] */
+                char* filename = NULL;
+                int max_depth = 0;
+                token = strtok_r(NULL, " ", &saveptr);
+                while (token)
+                {
+                    if (atoi(token) > 0)
+                        max_depth = atoi(token);
+                    else
+                        filename = token;
+                    token = strtok_r(NULL, " ", &saveptr);
+                }
+                stop_search_thread();
+                perft_suite(filename, max_depth);
+            }
+            else
+            {
+                /* perft [divide] [hash] [stats] <depth> [threads <n>]
+                 * [split <ply>]. Plain perft prints the statistics, the
+                 * other modes only count nodes unless stats is given */
+                PerftJob perft_job;
+                memset(&perft_job, 0, sizeof(PerftJob));
+                perft_job.threads = 1;
+                perft_job.split = 1;
+                int divide = 0;
+                while (token)
+                {
+                    if (!strcmp(token, "divide"))
+                        divide = 1;
+                    else if (!strcmp(token, "hash"))
+                        perft_job.use_hash = 1;
+                    else if (!strcmp(token, "stats"))
+                        perft_job.stats = 1;
+                    else if (!strcmp(token, "threads") &&
+                            (token = strtok_r(NULL, " ", &saveptr)))
+                        perft_job.threads = atoi(token);
+                    else if (!strcmp(token, "split") &&
+                            (token = strtok_r(NULL, " ", &saveptr)))
+                        perft_job.split = atoi(token);
+                    else
+                        perft_job.depth = atoi(token);
+                    token = strtok_r(NULL, " ", &saveptr);
+                }
+                if (!divide && !perft_job.use_hash)
+                    perft_job.stats = 1;
+                stop_search_thread();
+                if (perft_job.depth < 1)
+                    perft_job.depth = 1;
+                if (divide)
+                    perft_divide(&board, &perft_job);
+                else
+                {
+                    long start = get_time_ms();
+                    Pres pres = perft_parallel(&board, &perft_job, NULL);
+                    long elapsed = get_time_ms() - start;
+                    if (perft_job.failed)
+                    {
+                        free(message);
+                        continue;
+                    }
+                    printf("%ld nodes at %d depth\n", pres.nodes,
+                            perft_job.depth);
+                    if (perft_job.stats)
+                    {
+                        printf("%ld captures, %ld en pessants\n", pres.caps,
+                                pres.eps);
+                        printf("%ld checks, %ld checkmates\n", pres.checks,
+                                pres.checkmates);
+                        printf("%ld castles, %ld promotions\n",
+                                pres.castles, pres.proms);
+                    }
+                    printf("time %ld ms %.2f Mnps\n", elapsed,
+                            (double)pres.nodes / 1000 /
+                            (elapsed ? elapsed : 1));
+                    fflush(stdout);
+                }
+            }
         }
         free(message);
     }
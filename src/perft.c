@@ -0,0 +1,565 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "board.h"
+#include "io.h"
+#include "timeman.h"
+#include "perft.h"
+
+/* Default perft suite in EPD form, each position followed by its node count
+ * at one or more depths: the start position, Kiwipete and the other standard
+ * positions from the Chess Programming Wiki, then positions that test en
+ * passant, castling, promotion and mate edge cases */
+const char* perft_positions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 ;D1 20 ;D2 400 "
+        ";D3 8902 ;D4 197281",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1 "
+        ";D1 48 ;D2 2039 ;D3 97862 ;D4 4085603",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1 ;D1 14 ;D2 191 ;D3 2812 "
+        ";D4 43238 ;D5 674624",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1 ;D1 6 "
+        ";D2 264 ;D3 9467 ;D4 422333",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8 ;D1 44 "
+        ";D2 1486 ;D3 62379",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10 "
+        ";D1 46 ;D2 2079 ;D3 89890",
+    "3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1 ;D6 1134888",
+    "8/8/4k3/8/2p5/8/B2P2K1/8 w - - 0 1 ;D6 1015133",
+    "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1 ;D6 1440467",
+    "5k2/8/8/8/8/8/8/4K2R w K - 0 1 ;D6 661072",
+    "3k4/8/8/8/8/8/8/R3K3 w Q - 0 1 ;D6 803711",
+    "r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1 ;D4 1274206",
+    "r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1 ;D4 1720476",
+    "2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1 ;D6 3821001",
+    "8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1 ;D5 1004658",
+    "4k3/1P6/8/8/8/8/K7/8 w - - 0 1 ;D6 217342",
+    "8/P1k5/K7/8/8/8/8/8 w - - 0 1 ;D6 92683",
+    "K1k5/8/P7/8/8/8/8/8 w - - 0 1 ;D6 2217",
+    "8/k1P5/8/1K6/8/8/8/8 w - - 0 1 ;D7 567584",
+    "8/8/2k5/5q2/5n2/8/5K2/8 b - - 0 1 ;D4 23527",
+};
+const int num_perft_positions = sizeof(perft_positions) / sizeof(char*);
+
+/* Hash table for perft node counts, kept apart from the search's table */
+PerftEntry* perft_table = NULL;
+uint64_t perft_table_size = 0;
+
+/*******************************************************************************
+ * Allocates a ply stack deep enough for a perft of the given depth, to be
+ * freed by the caller
+ *
+ * @param depth The depth of the perft
+ * @return The stack, or NULL if it could not be allocated
+ ******************************************************************************/
+PerftPly* perft_stack_alloc(int depth)
+{
+    PerftPly* stack = malloc(sizeof(PerftPly) * (depth + 1));
+    if (!stack)
+        perror("from perft_stack_alloc");
+    return stack;
+}
+
+/*******************************************************************************
+ * Perft function to find the node count of a certain depth
+ *
+ * @param board The board to calculate for
+ * @param depth The depth at which to search
+ * @return the number of nodes found
+ ******************************************************************************/
+Pres perft(Board* board, int depth)
+{
+    Pres pres;
+    memset(&pres, 0, sizeof(Pres));
+    PerftPly* stack = perft_stack_alloc(depth);
+    if (!stack)
+        return pres;
+    int num_moves = gen_all_moves(board, stack->moves);
+    int i;
+    for (i = 0; i < num_moves; ++i)
+        get_nodes(board, &stack->moves[i], depth - 1, &pres, stack + 1);
+    free(stack);
+    return pres;
+}
+
+/*******************************************************************************
+ * Recursive function that implements Perft function. stack holds the board
+ * after cand and the moves from it, and one ply more for every level below.
+ ******************************************************************************/
+void get_nodes(Board* board, Cand* cand, int depth, Pres* pres,
+        PerftPly* stack)
+{
+    Board* temp_board = &stack->board;
+    memcpy(temp_board, board, sizeof(Board));
+    if (depth == 0)
+    {
+        if (board->to_move == BLACK && (board->all_white & cand->move.dest))
+            pres->caps++;
+        else if (board->to_move == WHITE && (board->all_black & cand->move.dest))
+            pres->caps++;
+        if ((board->en_p & cand->move.dest) && cand->move.piece == PAWN)
+        {
+            pres->caps++;
+            pres->eps++;
+        }
+        if (cand->move.piece == KING && cand->move.color == WHITE)
+        {
+            if ((cand->move.src & 0x8ULL) && (cand->move.dest & 0x22ULL))
+            {
+                pres->castles++;
+                //print_board(temp_board);
+            }
+        }
+        if (cand->move.piece == KING && cand->move.color == BLACK)
+        {
+            if ((cand->move.src & (0x8ULL << 56)) && (cand->move.dest &
+                        (0x22ULL << 56)))
+            {
+                pres->castles++;
+                //print_board(temp_board);
+            }
+        }
+        if (cand->move.promote != -1)
+            pres->proms++;
+        pres->nodes++;
+    }
+    move_piece(temp_board, &cand->move);
+    if (depth == 0)
+    {
+        if (temp_board->to_move == BLACK && (temp_board->pieces[BLACK + KING] &
+                    gen_all_dests(temp_board, WHITE)))
+            pres->checks++;
+        if (temp_board->to_move == WHITE && (temp_board->pieces[WHITE + KING] &
+                    gen_all_dests(temp_board, BLACK)))
+            pres->checks++;
+        if (is_checkmate(temp_board, temp_board->to_move))
+        {
+            pres->checkmates++;
+            //print_board(temp_board);
+        }
+        if (cand->move.piece == KING && cand->move.color == WHITE)
+        {
+            if ((cand->move.src & 0x8ULL) && (cand->move.dest & 0x22ULL))
+            {
+                //print_board(temp_board);
+            }
+        }
+        if (cand->move.piece == KING && cand->move.color == BLACK)
+        {
+            if ((cand->move.src & (0x8ULL << 56)) && (cand->move.dest &
+                        (0x22ULL << 56)))
+            {
+                //print_board(temp_board);
+            }
+        }
+
+        return;
+    }
+    int num_moves = gen_all_moves(temp_board, stack->moves);
+    int i;
+    for (i = 0; i < num_moves; ++i)
+        get_nodes(temp_board, &stack->moves[i], depth - 1, pres, stack + 1);
+}
+
+/*******************************************************************************
+ * Reallocates the perft hash table to the largest power of two number of
+ * entries that fits in the given number of MB, and clears it
+ *
+ * @param mb The size of the table in MB
+ ******************************************************************************/
+void perft_hash_resize(uint64_t mb)
+{
+    uint64_t entries = 1;
+    if (mb < 1)
+        mb = 1;
+    while (entries * 2 * sizeof(PerftEntry) <= mb * 1024 * 1024)
+        entries *= 2;
+    if (perft_table)
+        free(perft_table);
+    perft_table_size = entries;
+    perft_table = calloc(perft_table_size, sizeof(PerftEntry));
+}
+
+/*******************************************************************************
+ * Empties the perft hash table, allocating it at the default size if there is
+ * none yet
+ ******************************************************************************/
+void perft_hash_clear()
+{
+    if (!perft_table)
+        perft_hash_resize(PERFT_HASH_MB);
+    else
+        memset(perft_table, 0, perft_table_size * sizeof(PerftEntry));
+}
+
+/*******************************************************************************
+ * Counts the leaf nodes at a depth without any of the statistics of perft.
+ * Moves at the last ply are only counted, never made. With use_hash set,
+ * subtrees that were counted before are looked up in the perft hash table
+ * instead of being walked again.
+ *
+ * @param board The board to count from
+ * @param depth The depth to count to
+ * @param use_hash Whether to use the perft hash table
+ * @param stack The ply stack, at least depth plies deep
+ * @return The number of leaf nodes
+ ******************************************************************************/
+uint64_t perft_count(Board* board, int depth, int use_hash, PerftPly* stack)
+{
+    if (depth == 0)
+        return 1;
+    /* The last ply is counted, not made */
+    if (depth == 1)
+        return count_legal_moves(board);
+    PerftEntry* slot = NULL;
+    if (use_hash && depth >= 2)
+    {
+        if (!perft_table)
+            perft_hash_resize(PERFT_HASH_MB);
+        slot = &perft_table[board->hash & (perft_table_size - 1)];
+        uint64_t data = slot->data;
+        if ((slot->key ^ data) == board->hash &&
+                (int)(data & ((1 << PERFT_DEPTH_BITS) - 1)) == depth)
+            return data >> PERFT_DEPTH_BITS;
+    }
+    int num_moves = gen_all_moves(board, stack->moves);
+    uint64_t nodes = 0;
+    int i;
+    for (i = 0; i < num_moves; ++i)
+    {
+        memcpy(&stack->board, board, sizeof(Board));
+        move_piece(&stack->board, &stack->moves[i].move);
+        nodes += perft_count(&stack->board, depth - 1, use_hash, stack + 1);
+    }
+    if (slot)
+    {
+        uint64_t data = (nodes << PERFT_DEPTH_BITS) | depth;
+        slot->key = board->hash ^ data;
+        slot->data = data;
+    }
+    return nodes;
+}
+
+/*******************************************************************************
+ * Adds every move at the job's split ply below a position to the job's work
+ * list
+ *
+ * @param job The perft job to add to
+ * @param board The position to expand
+ * @param ply The ply of the position, counting the root as 0
+ * @param root The index of the root move the position descends from, or -1
+ *             at the root itself
+ * @param stack The ply stack, from the position's ply to the split ply
+ ******************************************************************************/
+void perft_add_work(PerftJob* job, Board* board, int ply, int root,
+        PerftPly* stack)
+{
+    Cand* cans = stack->moves;
+    int num_moves = gen_all_moves(board, cans);
+    int i;
+    for (i = 0; i < num_moves; ++i)
+    {
+        int move_root = (root < 0) ? i : root;
+        if (ply + 1 < job->split)
+        {
+            memcpy(&stack->board, board, sizeof(Board));
+            move_piece(&stack->board, &cans[i].move);
+            perft_add_work(job, &stack->board, ply + 1, move_root, stack + 1);
+            if (job->failed)
+                return;
+            continue;
+        }
+        if (job->num_work == job->work_size)
+        {
+            int work_size = job->work_size ? job->work_size * 2 :
+                MOVES_PER_POSITION;
+            PerftWork* grown = realloc(job->work, work_size *
+                    sizeof(PerftWork));
+            if (!grown)
+            {
+                perror("from perft_add_work");
+                job->failed = 1;
+                return;
+            }
+            job->work = grown;
+            job->work_size = work_size;
+        }
+        PerftWork* work = &job->work[job->num_work++];
+        memcpy(&work->board, board, sizeof(Board));
+        work->cand = cans[i];
+        work->root = move_root;
+        memset(&work->pres, 0, sizeof(Pres));
+    }
+}
+
+/*******************************************************************************
+ * Entry point of a perft thread. Takes subtrees off the job's work list until
+ * none are left, so that a thread that finishes a small subtree early goes on
+ * with the next one instead of waiting for the others.
+ *
+ * @param arg The PerftJob to work on
+ ******************************************************************************/
+void* perft_worker(void* arg)
+{
+    PerftJob* job = (PerftJob*)arg;
+    int remaining = job->depth - job->split;
+    /* A thread without a stack leaves its share to the others */
+    PerftPly* stack = perft_stack_alloc(remaining);
+    if (!stack)
+        return NULL;
+    int i;
+    while ((i = atomic_fetch_add(&job->next_work, 1)) < job->num_work)
+    {
+        PerftWork* work = &job->work[i];
+        if (job->stats)
+        {
+            get_nodes(&work->board, &work->cand, remaining, &work->pres,
+                    stack);
+            continue;
+        }
+        memcpy(&stack->board, &work->board, sizeof(Board));
+        move_piece(&stack->board, &work->cand.move);
+        work->pres.nodes = perft_count(&stack->board, remaining,
+                job->use_hash, stack + 1);
+    }
+    free(stack);
+    return NULL;
+}
+
+/*******************************************************************************
+ * Runs perft on several threads. The tree is split into the subtrees below
+ * every move at the split ply, which the threads share out between them, and
+ * their results are summed once all threads are done.
+ *
+ * @param board The board to count from
+ * @param job The depth, number of threads, split ply and modes of the run.
+ *            Its work list is filled and freed here, and failed is set if
+ *            the list or the ply stacks could not be allocated.
+ * @param root_nodes If not NULL, filled with the node count below each root
+ *                   move in gen_all_moves order
+ * @return The summed node count and, in stats mode, statistics
+ ******************************************************************************/
+Pres perft_parallel(Board* board, PerftJob* job, uint64_t* root_nodes)
+{
+    Pres total;
+    memset(&total, 0, sizeof(Pres));
+    if (job->threads < 1)
+        job->threads = 1;
+    if (job->threads > PERFT_MAX_THREADS)
+        job->threads = PERFT_MAX_THREADS;
+    if (job->split < 1)
+        job->split = 1;
+    if (job->split > PERFT_MAX_SPLIT)
+        job->split = PERFT_MAX_SPLIT;
+    if (job->split > job->depth)
+        job->split = job->depth;
+    /* The table is shared, so it has to exist before the threads start. It
+     * starts empty so that the time measures this run and not the last. */
+    if (job->use_hash && !job->stats)
+        perft_hash_clear();
+    job->work = NULL;
+    job->num_work = 0;
+    job->work_size = 0;
+    job->failed = 0;
+    atomic_store(&job->next_work, 0);
+    PerftPly* stack = perft_stack_alloc(job->split);
+    if (!stack)
+    {
+        job->failed = 1;
+        return total;
+    }
+    perft_add_work(job, board, 0, -1, stack);
+    free(stack);
+    if (job->failed)
+    {
+        free(job->work);
+        job->work = NULL;
+        return total;
+    }
+
+    pthread_t threads[PERFT_MAX_THREADS];
+    int i;
+    for (i = 1; i < job->threads; ++i)
+    {
+        if (pthread_create(&threads[i], NULL, perft_worker, job))
+        {
+            perror("from perft_parallel");
+            break;
+        }
+    }
+    int started = i;
+    perft_worker(job);
+    for (i = 1; i < started; ++i)
+        pthread_join(threads[i], NULL);
+    /* Subtrees are only left over when no thread got a stack */
+    if (atomic_load(&job->next_work) < job->num_work)
+    {
+        job->failed = 1;
+        free(job->work);
+        job->work = NULL;
+        return total;
+    }
+
+    for (i = 0; i < job->num_work; ++i)
+    {
+        Pres* pres = &job->work[i].pres;
+        total.nodes += pres->nodes;
+        total.caps += pres->caps;
+        total.eps += pres->eps;
+        total.checks += pres->checks;
+        total.checkmates += pres->checkmates;
+        total.castles += pres->castles;
+        total.proms += pres->proms;
+        if (root_nodes)
+            root_nodes[job->work[i].root] += pres->nodes;
+    }
+    free(job->work);
+    job->work = NULL;
+    return total;
+}
+
+/*******************************************************************************
+ * Prints the leaf node count below every legal move in the usual "e2e4: 20"
+ * form, followed by the total, so that move generators can be compared move
+ * by move
+ *
+ * @param board The board to count from
+ * @param job The depth, at least 1, and the threads, split ply and modes of
+ *            the run. Stats mode prints the detailed statistics and rules out
+ *            the hash table.
+ ******************************************************************************/
+void perft_divide(Board* board, PerftJob* job)
+{
+    uint64_t root_nodes[MOVES_PER_POSITION] = {0};
+    Cand cans[MOVES_PER_POSITION];
+    int num_moves = gen_all_moves(board, cans);
+    long start = get_time_ms();
+    Pres total = perft_parallel(board, job, root_nodes);
+    long elapsed = get_time_ms() - start;
+    if (job->failed)
+        return;
+    int i;
+    for (i = 0; i < num_moves; ++i)
+    {
+        OutBuffer out;
+        buf_init(&out, 1);
+        buf_move(&out, &cans[i].move);
+        buf_printf(&out, ": %llu\n", (unsigned long long)root_nodes[i]);
+        buf_flush(&out);
+    }
+    printf("\nNodes searched: %llu\n", (unsigned long long)total.nodes);
+    if (job->stats)
+    {
+        printf("%ld captures, %ld en pessants\n", total.caps, total.eps);
+        printf("%ld checks, %ld checkmates\n", total.checks,
+                total.checkmates);
+        printf("%ld castles, %ld promotions\n", total.castles, total.proms);
+    }
+    printf("time %ld ms %.2f Mnps\n", elapsed,
+            (double)total.nodes / 1000 / (elapsed ? elapsed : 1));
+    fflush(stdout);
+}
+
+/*******************************************************************************
+ * Runs perft on one EPD line of the form "<fen> ;D1 20 ;D2 400 ..." and checks
+ * every node count it lists, printing a result line for each depth
+ *
+ * @param line The EPD line, which is modified while parsing
+ * @param max_depth Depths above this are skipped, 0 for no limit
+ * @param number The number of the position in the suite, for the output
+ * @param nodes Incremented by the number of nodes counted
+ * @param time Incremented by the time taken in msec
+ * @return The number of failed depths
+ ******************************************************************************/
+int perft_epd_line(char* line, int max_depth, int number, uint64_t* nodes,
+        long* time)
+{
+    char* fields = strchr(line, ';');
+    if (!fields)
+        return 0;
+    *fields++ = '\0';
+    Board board;
+    load_fen(&board, line);
+    printf("position %d: %s\n", number, line);
+
+    int failed = 0;
+    char* saveptr;
+    char* field = strtok_r(fields, ";", &saveptr);
+    while (field)
+    {
+        int depth;
+        unsigned long long expected;
+        if (sscanf(field, " D%d %llu", &depth, &expected) == 2 &&
+                (!max_depth || depth <= max_depth))
+        {
+            PerftPly* stack = perft_stack_alloc(depth);
+            if (!stack)
+                return failed + 1;
+            long start = get_time_ms();
+            uint64_t count = perft_count(&board, depth, 0, stack);
+            long elapsed = get_time_ms() - start;
+            free(stack);
+            int ok = count == expected;
+            printf("  depth %d nodes %llu expected %llu %s time %ld ms "
+                    "%.2f Mnps\n", depth, (unsigned long long)count,
+                    expected, ok ? "ok" : "FAIL", elapsed,
+                    (double)count / 1000 / (elapsed ? elapsed : 1));
+            failed += !ok;
+            *nodes += count;
+            *time += elapsed;
+        }
+        field = strtok_r(NULL, ";", &saveptr);
+    }
+    return failed;
+}
+
+/*******************************************************************************
+ * Verifies the move generator against a suite of positions with known perft
+ * node counts, read from an EPD file or taken from the built-in set, and
+ * prints the aggregate speed
+ *
+ * @param filename The EPD file to read, or NULL for the built-in set
+ * @param max_depth Depths above this are skipped, 0 for no limit
+ * @return The number of failed depths
+ ******************************************************************************/
+int perft_suite(char* filename, int max_depth)
+{
+    char line[EPD_LINE_LENGTH];
+    uint64_t nodes = 0;
+    long time = 0;
+    int failed = 0;
+    int number = 0;
+    if (filename)
+    {
+        FILE* epd = fopen(filename, "r");
+        if (!epd)
+        {
+            perror("from perft_suite");
+            return 1;
+        }
+        while (fgets(line, EPD_LINE_LENGTH, epd))
+        {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (strchr(line, ';'))
+                failed += perft_epd_line(line, max_depth, ++number, &nodes,
+                        &time);
+        }
+        fclose(epd);
+    }
+    else
+    {
+        int i;
+        for (i = 0; i < num_perft_positions; ++i)
+        {
+            strncpy(line, perft_positions[i], EPD_LINE_LENGTH - 1);
+            line[EPD_LINE_LENGTH - 1] = '\0';
+            failed += perft_epd_line(line, max_depth, ++number, &nodes, &time);
+        }
+    }
+    printf("perft suite %s: %d positions, %d failed, nodes %llu time %ld ms "
+            "%.2f Mnps\n", failed ? "FAILED" : "passed", number, failed,
+            (unsigned long long)nodes, time,
+            (double)nodes / 1000 / (time ? time : 1));
+    fflush(stdout);
+    return failed;
+}
@@ -0,0 +1,1280 @@
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <stdatomic.h>
+#include "board.h"
+#include "io.h"
+#include "zobrist.h"
+#include "search.h"
+#include "timeman.h"
+#include "stats.h"
+#include "trace.h"
+
+/* Move ordering state, reset before every search */
+int history[12][64];
+
+/* Per ply state of the search thread, indexed by ply. Entry ply + 1 holds the
+ * board after a move at ply, so the stack doubles as the undo list */
+SearchStack* search_stack = NULL;
+
+/* Node count and stop flag of the running search */
+uint64_t nodes;
+atomic_int stop_search;
+atomic_int pondering;
+int seldepth;
+long last_currmove;
+
+/* Set by the UCI debug command to print extra info strings */
+int debug_mode = 0;
+TimeManager time_manager;
+
+/* Triangular principal variation table of the running iteration, and the
+ * principal variation of the last completed iteration */
+Move pv_table[MAX_PLY][MAX_PLY];
+int pv_length[MAX_PLY];
+Move root_pv[MAX_PLY];
+int root_pv_length;
+
+/* Late move reduction amounts indexed by [depth][move number] */
+int reductions[MAX_PLY][MOVES_PER_POSITION];
+
+/* Number of quiet moves searched before late move pruning kicks in */
+const int lmp_counts[LMP_MAX_DEPTH + 1] = {0, 5, 8, 13};
+
+/* Shallow depth pruning margins in pawns per ply of remaining depth */
+int rfp_margin = 2;
+int futility_margin = 2;
+int razor_margin = 3;
+
+/* Number of best root moves to search and report */
+int multi_pv = 1;
+
+/* Search parameters that can be changed with setoption */
+const SearchParam search_params[] = {
+    {"MultiPV", &multi_pv, 1, MOVES_PER_POSITION},
+    {"RFPMargin", &rfp_margin, 0, 50},
+    {"FutilityMargin", &futility_margin, 0, 50},
+    {"RazorMargin", &razor_margin, 0, 50},
+};
+const int num_search_params = sizeof(search_params) / sizeof(SearchParam);
+
+/* Piece values used for MVV-LVA ordering, indexed by piece type */
+const int order_values[6] = {1, 3, 3, 5, 9, 10};
+
+/*******************************************************************************
+ * Fills the late move reduction table. Reductions grow with the logarithm of
+ * both the remaining depth and the number of moves already searched
+ ******************************************************************************/
+void search_init()
+{
+    int d, m;
+    for (d = 0; d < MAX_PLY; ++d)
+    {
+        for (m = 0; m < MOVES_PER_POSITION; ++m)
+        {
+            if (d == 0 || m == 0)
+                reductions[d][m] = 0;
+            else
+                reductions[d][m] = (int)(0.75 + log(d) * log(m) / 2.25);
+        }
+    }
+    search_stack = malloc(sizeof(SearchStack) * (MAX_PLY + 1));
+    search_clear();
+}
+
+/*******************************************************************************
+ * Prints a UCI option line for every tunable search parameter
+ *
+ * @param fd The file descriptor to write the options to
+ ******************************************************************************/
+void print_search_params(int fd)
+{
+    int i;
+    for (i = 0; i < num_search_params; ++i)
+    {
+        char s[100];
+        sprintf(s, "option name %s type spin default %d min %d max %d\n",
+                search_params[i].name, *search_params[i].value,
+                search_params[i].min, search_params[i].max);
+        if(write(fd, s, strlen(s)) == -1)
+            perror("from print_search_params");
+    }
+}
+
+/*******************************************************************************
+ * Sets a tunable search parameter by its UCI option name
+ *
+ * @param name The name of the option, compared case insensitively
+ * @param value The new value, clamped to the range of the option
+ * @return 1 if the option exists, 0 otherwise
+ ******************************************************************************/
+int set_search_param(char* name, int value)
+{
+    int i;
+    for (i = 0; i < num_search_params; ++i)
+    {
+        if (strcasecmp(name, search_params[i].name))
+            continue;
+        if (value < search_params[i].min)
+            value = search_params[i].min;
+        if (value > search_params[i].max)
+            value = search_params[i].max;
+        *search_params[i].value = value;
+        return 1;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+ * Clears the history table and the killers and other per ply state of the
+ * search stack. The move lists and boards are always written before use.
+ ******************************************************************************/
+void search_clear()
+{
+    int ply;
+    memset(history, 0, sizeof(history));
+    for (ply = 0; ply <= MAX_PLY; ++ply)
+    {
+        SearchStack* ss = &search_stack[ply];
+        memset(ss->killers, 0, sizeof(ss->killers));
+        memset(&ss->excluded, 0, sizeof(Move));
+        ss->in_check = 0;
+        ss->extensions = 0;
+        ss->pv_follow = 0;
+    }
+}
+
+/*******************************************************************************
+ * Counts a node and checks whether the search has run out of time or nodes.
+ * Once the stop flag is set every search function returns immediately and
+ * the partial results are thrown away.
+ *
+ * @return 1 if the search has to stop, 0 otherwise
+ ******************************************************************************/
+int check_stop()
+{
+    nodes++;
+    if (!stop_search && !pondering && tm_out_of_time(&time_manager, nodes))
+        stop_search = 1;
+    return stop_search;
+}
+
+/*******************************************************************************
+ * Checks whether two moves describe the same piece movement
+ ******************************************************************************/
+int same_move(Move* one, Move* two)
+{
+    return one->src == two->src && one->dest == two->dest &&
+        one->promote == two->promote;
+}
+
+/*******************************************************************************
+ * Checks whether a move captures an enemy piece, including en passant
+ *
+ * @param board The board the move is made on
+ * @param move The move to check
+ ******************************************************************************/
+int is_capture(Board* board, Move* move)
+{
+    uint64_t enemies = (move->color == WHITE) ? board->all_black :
+        board->all_white;
+    if (move->dest & enemies)
+        return 1;
+    return move->piece == PAWN && (move->dest & board->en_p);
+}
+
+/*******************************************************************************
+ * Returns the type of the piece standing on the given square, or -1 if the
+ * square is empty
+ ******************************************************************************/
+int piece_on(Board* board, uint64_t square)
+{
+    int i;
+    for (i = 0; i < 12; ++i)
+    {
+        if (board->pieces[i] & square)
+            return i % 6;
+    }
+    return -1;
+}
+
+/*******************************************************************************
+ * Weighs the generated moves for the search and sorts them best first.
+ * The move from the previous iteration's principal variation is tried first,
+ * then the transposition table move, then captures and promotions in MVV-LVA
+ * order, then the killer moves for this ply, then the remaining quiet moves by
+ * their history score.
+ *
+ * @param board The board the moves were generated from
+ * @param cans The generated moves
+ * @param num_moves The number of generated moves
+ * @param ply The distance from the root of the search
+ * @param tt_move The packed best move from the transposition table, or 0
+ * @param pv_move The previous principal variation's move at this node, or NULL
+ ******************************************************************************/
+void order_moves(Board* board, Cand* cans, int num_moves, int ply,
+        uint16_t tt_move, Move* pv_move)
+{
+    int i;
+    for (i = 0; i < num_moves; ++i)
+    {
+        Move* move = &cans[i].move;
+        if (pv_move && same_move(move, pv_move))
+            cans[i].weight = (1 << 22);
+        else if (tt_move && pack_move(move) == tt_move)
+            cans[i].weight = (1 << 21);
+        else if (is_capture(board, move) || move->promote != -1)
+        {
+            int victim = piece_on(board, move->dest);
+            if (victim < 0)
+                victim = PAWN;
+            int weight = 16 * order_values[victim] - order_values[move->piece];
+            if (move->promote != -1)
+                weight += 16 * order_values[move->promote];
+            cans[i].weight = (1 << 20) + weight;
+        }
+        else if (same_move(move, &search_stack[ply].killers[0]))
+            cans[i].weight = (1 << 19) + 1;
+        else if (same_move(move, &search_stack[ply].killers[1]))
+            cans[i].weight = (1 << 19);
+        else
+            cans[i].weight = history[move->color + move->piece]
+                [bitScanForward(move->dest)];
+    }
+    qsort(cans, num_moves, sizeof(Cand), comp_cand);
+}
+
+/*******************************************************************************
+ * Applies a history gravity update so scores saturate at +-HISTORY_MAX
+ ******************************************************************************/
+void update_history(Move* move, int bonus)
+{
+    int* entry = &history[move->color + move->piece]
+        [bitScanForward(move->dest)];
+    int abs_bonus = (bonus < 0) ? -bonus : bonus;
+    *entry += bonus - *entry * abs_bonus / HISTORY_MAX;
+}
+
+/*******************************************************************************
+ * Rewards a quiet move that caused a beta cutoff and penalizes the quiet moves
+ * that were searched before it without success
+ ******************************************************************************/
+void update_quiet_stats(Move* best, Move* quiets, int num_quiets, int depth,
+        int ply)
+{
+    int bonus = depth * depth;
+    int i;
+    if (bonus > 400)
+        bonus = 400;
+    update_history(best, bonus);
+    for (i = 0; i < num_quiets; ++i)
+        update_history(&quiets[i], -bonus);
+    Move* killers = search_stack[ply].killers;
+    if (!same_move(best, &killers[0]))
+    {
+        killers[1] = killers[0];
+        killers[0] = *best;
+    }
+}
+
+/*******************************************************************************
+ * Makes a move the start of the principal variation at this ply, followed by
+ * the principal variation of the position it leads to
+ ******************************************************************************/
+void update_pv(Move* move, int ply)
+{
+    int i;
+    pv_table[ply][ply] = *move;
+    for (i = ply + 1; i < pv_length[ply + 1]; ++i)
+        pv_table[ply][i] = pv_table[ply + 1][i];
+    pv_length[ply] = (pv_length[ply + 1] > ply + 1) ? pv_length[ply + 1] :
+        ply + 1;
+}
+
+/*******************************************************************************
+ * Scores a position that has reached the fifty-move limit. The rule only
+ * draws if the side to move is not mated, since a mate on the move that
+ * reaches the limit stands.
+ *
+ * @param board The board to score
+ * @param in_check Whether the side to move is in check
+ * @param ply The distance from the root of the search
+ * @return The score of the position from the point of view of the side to move
+ ******************************************************************************/
+int fifty_move_score(Board* board, int in_check, int ply)
+{
+    if (in_check && !count_legal_moves(board))
+        return -MATE_SCORE + ply;
+    return DRAW_SCORE;
+}
+
+/*******************************************************************************
+ * Negamax alpha-beta search with principal variation search, late move
+ * reductions and late move pruning. Scores are from the point of view of the
+ * side to move.
+ *
+ * @param board The board to search. Its position must already have been added
+ *              to the repetition table, and search_stack[ply].in_check set,
+ *              by the caller
+ * @param alpha The lower bound of the search window
+ * @param beta The upper bound of the search window
+ * @param depth The remaining depth to search
+ * @param ply The distance from the root of the search
+ * @return The score of the position
+ ******************************************************************************/
+int alphaBeta(Board* board, int alpha, int beta, int depth, int ply)
+{
+    pv_length[ply] = ply;
+    int pv_node = beta - alpha > 1;
+    SearchStack* ss = &search_stack[ply];
+    Board* child = &search_stack[ply + 1].board;
+    Move* excluded = &ss->excluded;
+    if (ply && (is_threefold(board) || is_material_draw(board)))
+        return DRAW_SCORE;
+    if (ply && board->halfmove >= FIFTY_MOVE_PLIES)
+        return fifty_move_score(board, ss->in_check, ply);
+    /* A move that repeats an earlier position of the line secures a draw */
+    if (ply && alpha < DRAW_SCORE && has_game_cycle(board, ply))
+    {
+        alpha = DRAW_SCORE;
+        if (alpha >= beta)
+            return alpha;
+    }
+    /* A check at the horizon gets one more ply, charged to the line's
+     * extensions. Once they are used up, quiesce searches the evasions. */
+    int in_check = ss->in_check;
+    if (in_check && depth <= 0 && ss->extensions < MAX_LINE_EXTENSIONS)
+    {
+        depth = 1;
+        ss->extensions++;
+    }
+    if (depth <= 0 || ply >= MAX_PLY - 1)
+        return quiesce(board, alpha, beta, ply);
+    if (check_stop())
+        return 0;
+    if (ply > seldepth)
+        seldepth = ply;
+    STAT_INC(main_nodes);
+    STAT_PLY(ply);
+
+    TEntry entry;
+    STAT_TIMER_START(tt_start);
+    int tt_hit = !excluded->src && probe_hash(board, &entry);
+    STAT_TIMER_STOP(tt_start, PHASE_TT);
+    if (!excluded->src)
+    {
+        STAT_INC(tt_probes);
+        ss->tt_result = tt_hit ? TRACE_TT_HIT : TRACE_TT_MISS;
+    }
+    if (tt_hit)
+        STAT_INC(tt_hits);
+    uint16_t tt_move = tt_hit ? entry.move : 0;
+    int tt_score = tt_hit ? score_from_tt(entry.score, ply) : 0;
+    if (tt_hit && !pv_node && entry.depth >= depth)
+    {
+        if (entry.flag == EXACT_BOUND ||
+                (entry.flag == LOWER_BOUND && tt_score >= beta) ||
+                (entry.flag == UPPER_BOUND && tt_score <= alpha))
+        {
+            STAT_INC(tt_cutoffs);
+            ss->tt_result = TRACE_TT_CUTOFF;
+            return tt_score;
+        }
+    }
+
+    STAT_TIMER_START(eval_start);
+    int static_eval = get_board_value(board);
+    STAT_TIMER_STOP(eval_start, PHASE_EVAL);
+    int can_prune = !pv_node && !in_check && !excluded->src &&
+        alpha > -MATE_BOUND && beta < MATE_BOUND;
+
+    /* Reverse futility pruning: the static eval beats beta by a margin */
+    if (can_prune && depth <= RFP_MAX_DEPTH &&
+            static_eval - rfp_margin * depth >= beta)
+        return static_eval;
+
+    /* Razoring: hopeless positions drop straight into quiescence */
+    if (can_prune && depth <= RAZOR_MAX_DEPTH &&
+            static_eval + razor_margin * depth < alpha)
+    {
+        int score = quiesce(board, alpha, beta, ply);
+        if (score < alpha)
+            return score;
+    }
+    /* ProbCut: a good capture that beats beta by a margin in a quiescence
+     * and a reduced depth search makes the full search unnecessary */
+    int probcut_beta = beta + PROBCUT_MARGIN;
+    if (!pv_node && !in_check && !excluded->src &&
+            depth >= PROBCUT_MIN_DEPTH && beta > -MATE_BOUND &&
+            probcut_beta < MATE_BOUND &&
+            !(tt_hit && entry.depth >= depth - PROBCUT_REDUCTION &&
+                tt_score < probcut_beta))
+    {
+        Cand* caps = ss->moves;
+        int num_caps = gen_search_attack_moves(board, caps);
+        order_moves(board, caps, num_caps, ply, tt_move, NULL);
+        int i;
+        for (i = 0; i < num_caps; ++i)
+        {
+            Move* move = &caps[i].move;
+            if (see(board, move) < probcut_beta - static_eval)
+                continue;
+            memcpy(child, board, sizeof(Board));
+            move_piece(child, move);
+            add_position(child);
+            search_stack[ply + 1].extensions = ss->extensions;
+            search_stack[ply + 1].pv_follow = 0;
+            /* Both searches are traced so that their subtrees do not end up
+             * under the next move searched at this ply */
+            int score = -quiesce(child, -probcut_beta, -probcut_beta + 1,
+                    ply + 1);
+            if (trace_buffer.records && !stop_search)
+                trace_node(ply + 1, move, probcut_beta - 1, probcut_beta,
+                        score, 0, 0, TRACE_PROBCUT, TRACE_TT_NONE);
+            if (score >= probcut_beta)
+            {
+                search_stack[ply + 1].in_check = is_in_check(child,
+                        child->to_move);
+                search_stack[ply + 1].tt_result = TRACE_TT_NONE;
+                score = -alphaBeta(child, -probcut_beta, -probcut_beta + 1,
+                        depth - PROBCUT_REDUCTION, ply + 1);
+                if (trace_buffer.records && !stop_search)
+                    trace_node(ply + 1, move, probcut_beta - 1, probcut_beta,
+                            score, depth - PROBCUT_REDUCTION, 0,
+                            TRACE_PROBCUT, search_stack[ply + 1].tt_result);
+            }
+            remove_position();
+            if (stop_search)
+                return 0;
+            if (score >= probcut_beta)
+            {
+                store_hash(board, score_to_tt(score, ply),
+                        depth - PROBCUT_REDUCTION + 1, LOWER_BOUND,
+                        pack_move(move));
+                return score;
+            }
+        }
+    }
+
+    int futile = can_prune && depth <= FUTILITY_MAX_DEPTH &&
+        static_eval + futility_margin * depth <= alpha;
+
+    Cand* cans = ss->moves;
+    STAT_TIMER_START(gen_start);
+    int num_moves = gen_search_moves(board, cans);
+    STAT_TIMER_STOP(gen_start, PHASE_GEN);
+    if (!num_moves)
+        return in_check ? -MATE_SCORE + ply : DRAW_SCORE;
+    Move* pv_move = (ss->pv_follow && ply < root_pv_length) ?
+        &root_pv[ply] : NULL;
+    order_moves(board, cans, num_moves, ply, tt_move, pv_move);
+
+    /* The TT move is singular when every alternative fails low against a
+     * bound just under its score in a reduced depth search */
+    int singular = 0;
+    if (depth >= SE_MIN_DEPTH && tt_move && !excluded->src &&
+            entry.flag != UPPER_BOUND && entry.depth >= depth - 3 &&
+            tt_score > -MATE_BOUND && tt_score < MATE_BOUND &&
+            ss->extensions < MAX_LINE_EXTENSIONS &&
+            pack_move(&cans[0].move) == tt_move)
+    {
+        int singular_beta = tt_score - SE_MARGIN;
+        *excluded = cans[0].move;
+        int score = alphaBeta(board, singular_beta - 1, singular_beta,
+                (depth - 1) / 2, ply);
+        /* The exclusion search gets a record of its own at this ply, which
+         * its children hang under instead of under this node */
+        if (trace_buffer.records && !stop_search)
+            trace_node(ply, excluded, -singular_beta, -singular_beta + 1,
+                    -score, (depth - 1) / 2, 0, TRACE_SINGULAR,
+                    TRACE_TT_NONE);
+        excluded->src = EMPTY;
+        pv_length[ply] = ply;
+        if (stop_search)
+            return 0;
+        singular = score < singular_beta;
+        /* The exclusion search shares this ply's move list, so rebuild it */
+        num_moves = gen_search_moves(board, cans);
+        order_moves(board, cans, num_moves, ply, tt_move, pv_move);
+    }
+
+    Move* quiets = ss->quiets;
+    Move best_move = cans[0].move;
+    int num_quiets = 0;
+    int searched = 0;
+    int old_alpha = alpha;
+    int best_score = -MATE_SCORE + ply;
+    int i;
+    for (i = 0; i < num_moves; ++i)
+    {
+        Move* move = &cans[i].move;
+        if (excluded->src && same_move(move, excluded))
+            continue;
+        int quiet = !is_capture(board, move) && move->promote == -1;
+        memcpy(child, board, sizeof(Board));
+        move_piece(child, move);
+        int gives_check = is_in_check(child, child->to_move);
+
+        /* Futility pruning: quiet moves cannot bring the eval up to alpha */
+        if (futile && quiet && !gives_check && best_score > -MATE_BOUND)
+            continue;
+
+        /* Late move pruning: skip late quiet moves at shallow non-PV nodes */
+        if (!pv_node && !in_check && quiet && !gives_check &&
+                depth <= LMP_MAX_DEPTH && num_quiets >= lmp_counts[depth] &&
+                best_score > -MATE_BOUND)
+            continue;
+
+        int extension = 0;
+        if (ss->extensions < MAX_LINE_EXTENSIONS &&
+                (gives_check || (singular && i == 0)))
+            extension = 1;
+        search_stack[ply + 1].in_check = gives_check;
+        search_stack[ply + 1].extensions = ss->extensions + extension;
+        search_stack[ply + 1].pv_follow = pv_move && same_move(move, pv_move);
+
+        add_position(child);
+        int new_depth = depth - 1 + extension;
+        int score;
+        if (searched == 0)
+            score = search_child(child, move, alpha, beta, new_depth, ply, 0);
+        else
+        {
+            int r = 0;
+            if (depth >= LMR_MIN_DEPTH && i >= LMR_MIN_MOVES && quiet &&
+                    !in_check)
+            {
+                r = reductions[depth < MAX_PLY ? depth : MAX_PLY - 1][i];
+                if (pv_node)
+                    r--;
+                if (gives_check)
+                    r--;
+                r -= history[move->color + move->piece]
+                    [bitScanForward(move->dest)] / HISTORY_REDUCTION_DIVISOR;
+                if (r > new_depth - 1)
+                    r = new_depth - 1;
+                if (r < 0)
+                    r = 0;
+            }
+            score = search_child(child, move, alpha, alpha + 1,
+                    new_depth - r, ply, r);
+            if (score > alpha && r)
+                score = search_child(child, move, alpha, alpha + 1,
+                        new_depth, ply, 0);
+            if (score > alpha && score < beta)
+                score = search_child(child, move, alpha, beta, new_depth, ply,
+                        0);
+        }
+        remove_position();
+        if (stop_search)
+            return 0;
+        searched++;
+
+        if (score > best_score)
+        {
+            best_score = score;
+            best_move = *move;
+        }
+        if (score > alpha)
+        {
+            alpha = score;
+            update_pv(move, ply);
+            if (alpha >= beta)
+            {
+                STAT_CUTOFF(searched - 1);
+                if (quiet)
+                    update_quiet_stats(move, quiets, num_quiets, depth, ply);
+                break;
+            }
+        }
+        if (quiet)
+            quiets[num_quiets++] = *move;
+    }
+
+    if (!excluded->src)
+    {
+        int flag = EXACT_BOUND;
+        if (best_score >= beta)
+            flag = LOWER_BOUND;
+        else if (best_score <= old_alpha)
+            flag = UPPER_BOUND;
+        STAT_TIMER_START(store_start);
+        store_hash(board, score_to_tt(best_score, ply), depth, flag,
+                pack_move(&best_move));
+        STAT_TIMER_STOP(store_start, PHASE_TT);
+    }
+    return best_score;
+}
+
+/*******************************************************************************
+ * Searches the position after a move and returns its score for the side that
+ * made the move. With tracing on, the node is added to the trace.
+ *
+ * @param child The board after the move
+ * @param move The move that was made
+ * @param alpha The lower bound of the window, for the side that made the move
+ * @param beta The upper bound of the window
+ * @param depth The depth to search the child to
+ * @param ply The ply of the position the move was made from
+ * @param reduction The late move reduction already taken off depth
+ * @return The score of the move
+ ******************************************************************************/
+int search_child(Board* child, Move* move, int alpha, int beta, int depth,
+        int ply, int reduction)
+{
+    search_stack[ply + 1].tt_result = TRACE_TT_NONE;
+    int score = -alphaBeta(child, -beta, -alpha, depth, ply + 1);
+    if (trace_buffer.records && !stop_search)
+        trace_node(ply + 1, move, alpha, beta, score, depth, reduction,
+                beta - alpha > 1 ? TRACE_PV : TRACE_NONPV,
+                search_stack[ply + 1].tt_result);
+    return score;
+}
+
+/*******************************************************************************
+ * Converts a score to the form stored in the transposition table, where mate
+ * scores count the distance from the stored position instead of the root
+ ******************************************************************************/
+int score_to_tt(int score, int ply)
+{
+    if (score >= MATE_BOUND)
+        return score + ply;
+    if (score <= -MATE_BOUND)
+        return score - ply;
+    return score;
+}
+
+/*******************************************************************************
+ * Converts a score read from the transposition table back to a root relative
+ * score
+ ******************************************************************************/
+int score_from_tt(int score, int ply)
+{
+    if (score >= MATE_BOUND)
+        return score - ply;
+    if (score <= -MATE_BOUND)
+        return score + ply;
+    return score;
+}
+
+/*******************************************************************************
+ * Quiescence search that only looks at captures so that the static evaluation
+ * is never taken in the middle of an exchange. In check there is no standing
+ * pat: every evasion is searched and having none is mate.
+ *
+ * @param board The board to search
+ * @param alpha The lower bound of the search window
+ * @param beta The upper bound of the search window
+ * @param ply The distance from the root of the search
+ * @return The score of the position from the point of view of the side to move
+ ******************************************************************************/
+int quiesce(Board* board, int alpha, int beta, int ply)
+{
+    if (check_stop())
+        return 0;
+    if (ply > seldepth)
+        seldepth = ply;
+    STAT_INC(qnodes);
+    STAT_PLY(ply);
+    if (is_material_draw(board))
+        return DRAW_SCORE;
+    int in_check = is_in_check(board, board->to_move);
+    if (board->halfmove >= FIFTY_MOVE_PLIES)
+        return fifty_move_score(board, in_check, ply);
+    STAT_TIMER_START(eval_start);
+    int stand_pat = get_board_value(board);
+    STAT_TIMER_STOP(eval_start, PHASE_EVAL);
+    if (ply >= MAX_PLY - 1)
+        return stand_pat;
+    if (!in_check && stand_pat >= beta)
+        return stand_pat;
+    if (!in_check && stand_pat > alpha)
+        alpha = stand_pat;
+    Cand* cans = search_stack[ply].moves;
+    Board* child = &search_stack[ply + 1].board;
+    STAT_TIMER_START(gen_start);
+    int num_moves = in_check ? gen_search_moves(board, cans) :
+        gen_search_attack_moves(board, cans);
+    STAT_TIMER_STOP(gen_start, PHASE_GEN);
+    order_moves(board, cans, num_moves, ply, 0, NULL);
+    int best_score = in_check ? -MATE_SCORE + ply : stand_pat;
+    int i;
+    for (i = 0; i < num_moves; ++i)
+    {
+        memcpy(child, board, sizeof(Board));
+        move_piece(child, &cans[i].move);
+        int score = -quiesce(child, -beta, -alpha, ply + 1);
+        if (stop_search)
+            return 0;
+        if (trace_buffer.records)
+            trace_node(ply + 1, &cans[i].move, alpha, beta, score, 0, 0,
+                    TRACE_QS, TRACE_TT_NONE);
+        if (score > best_score)
+            best_score = score;
+        if (score > alpha)
+        {
+            alpha = score;
+            if (alpha >= beta)
+                break;
+        }
+    }
+    return best_score;
+}
+
+int alphaBetaMin_attack(Board* board, Cand* cand, int alpha, int beta, int depth);
+int alphaBetaMax_attack(Board* board, Cand* cand, int alpha, int beta, int depth)
+{
+    Board* temp_board = &search_stack[depth].board;
+    Cand* cans = search_stack[depth].moves;
+    memcpy(temp_board, board, sizeof(Board));
+    move_piece(temp_board, &cand->move);
+    int num_moves = gen_all_moves(temp_board, cans);
+    if (!num_moves)
+        return is_in_check(temp_board, temp_board->to_move) ? (-300 + depth) : 5;
+    num_moves = keep_attacks_on_square(cans, num_moves, cand->move.dest);
+    if (!num_moves || depth >= MAX_PLY - 1)
+        return get_board_value(temp_board);
+    int i;
+    int score;
+    for (i = 0; i < num_moves; ++i)
+    {
+        score = alphaBetaMin_attack(temp_board, &cans[i], alpha, beta, depth + 1);
+        if (score >= beta)
+            return beta;
+        if (score > alpha)
+            alpha = score;
+    }
+    return alpha;
+}
+
+int alphaBetaMin_attack(Board* board, Cand* cand, int alpha, int beta, int depth)
+{
+    Board* temp_board = &search_stack[depth].board;
+    Cand* cans = search_stack[depth].moves;
+    memcpy(temp_board, board, sizeof(Board));
+    move_piece(temp_board, &cand->move);
+    int num_moves = gen_all_moves(temp_board, cans);
+    if (!num_moves)
+        return is_in_check(temp_board, temp_board->to_move) ? (300 - depth) : -5;
+    num_moves = keep_attacks_on_square(cans, num_moves, cand->move.dest);
+    if (!num_moves || depth >= MAX_PLY - 1)
+        return -get_board_value(temp_board);
+    int i;
+    int score;
+    for (i = 0; i < num_moves; ++i)
+    {
+        score = alphaBetaMax_attack(temp_board, &cans[i], alpha, beta, depth + 1);
+        if (score <= alpha)
+            return alpha;
+        if (score < beta)
+            beta = score;
+    }
+    return beta;
+}
+
+/*******************************************************************************
+ * Searches every root move inside the given window. The first move is searched
+ * with the full window and the rest with a null window, re-searching the ones
+ * that beat alpha. The best move is moved to the front of the list, every
+ * root move gets its returned score and the nodes spent on it are added to
+ * its node count.
+ *
+ * @param board The board to search
+ * @param roots The root moves, best guess first
+ * @param num_moves The number of root moves
+ * @param alpha The lower bound of the aspiration window
+ * @param beta The upper bound of the aspiration window
+ * @param depth The depth to search each root move to
+ * @return The best score found, which is a bound if it falls outside the window
+ ******************************************************************************/
+int search_root(Board* board, RootMove* roots, int num_moves, int alpha,
+        int beta, int depth)
+{
+    int best_score = -MATE_SCORE;
+    int best_index = 0;
+    int i;
+    pv_length[0] = 0;
+    for (i = 0; i < num_moves; ++i)
+    {
+        report_currmove(&roots[i].move, depth, i + 1);
+        uint64_t nodes_before = nodes;
+        Board* child = &search_stack[1].board;
+        search_stack[1].extensions = 0;
+        search_stack[1].pv_follow = root_pv_length &&
+            same_move(&roots[i].move, &root_pv[0]);
+        memcpy(child, board, sizeof(Board));
+        move_piece(child, &roots[i].move);
+        search_stack[1].in_check = is_in_check(child, child->to_move);
+        add_position(child);
+        int score;
+        if (i == 0)
+            score = search_child(child, &roots[i].move, alpha, beta,
+                    depth - 1, 0, 0);
+        else
+        {
+            score = search_child(child, &roots[i].move, alpha, alpha + 1,
+                    depth - 1, 0, 0);
+            if (score > alpha && score < beta)
+                score = search_child(child, &roots[i].move, alpha, beta,
+                        depth - 1, 0, 0);
+        }
+        remove_position();
+        roots[i].nodes += nodes - nodes_before;
+        if (stop_search)
+            return best_score;
+        roots[i].score = score;
+        if (score > best_score)
+        {
+            best_score = score;
+            best_index = i;
+        }
+        if (score > alpha)
+        {
+            alpha = score;
+            update_pv(&roots[i].move, 0);
+            if (alpha >= beta)
+                break;
+        }
+    }
+    /* Unsearched moves after a fail high go to the back of the list */
+    for (++i; i < num_moves; ++i)
+        roots[i].score = -MATE_SCORE;
+    if (best_index)
+    {
+        RootMove best = roots[best_index];
+        memmove(roots + 1, roots, sizeof(RootMove) * best_index);
+        roots[0] = best;
+    }
+    return best_score;
+}
+
+/*******************************************************************************
+ * Orders root moves by the number of nodes their subtrees took, largest
+ * first. Moves that fail low all get the same score, but the harder a move
+ * was to refute the more likely it is to become the best move.
+ ******************************************************************************/
+int comp_root_nodes(const void* one, const void* two)
+{
+    if (((RootMove*)one)->nodes > ((RootMove*)two)->nodes)
+        return -1;
+    else if (((RootMove*)one)->nodes < ((RootMove*)two)->nodes)
+        return 1;
+    return 0;
+}
+
+/*******************************************************************************
+ * Appends the principal variation found at the root to an output buffer. When
+ * no root move raised alpha, as after a fail low, only the given best move is
+ * appended.
+ *
+ * @param out The buffer to append to
+ * @param best The best move at the root
+ ******************************************************************************/
+void buf_pv(OutBuffer* out, Move* best)
+{
+    int i;
+    if (!pv_length[0])
+    {
+        buf_printf(out, " ");
+        buf_move(out, best);
+        return;
+    }
+    for (i = 0; i < pv_length[0]; ++i)
+    {
+        buf_printf(out, " ");
+        buf_move(out, &pv_table[0][i]);
+    }
+}
+
+/*******************************************************************************
+ * Prints a UCI info line for a finished or failed search of the root
+ *
+ * @param best The best move found at the root
+ * @param depth The depth that was searched
+ * @param line The number of the line in MultiPV mode, from 1
+ * @param score The score of the search in pawns
+ * @param bound Whether the score is exact or a bound from an aspiration
+ *              window failure
+ ******************************************************************************/
+void report_iteration(Move* best, int depth, int line, int score, int bound)
+{
+    OutBuffer out;
+    buf_init(&out, 1);
+    long elapsed = tm_elapsed(&time_manager);
+    uint64_t nps = elapsed ? nodes * 1000 / elapsed : nodes;
+    buf_printf(&out, "info depth %d seldepth %d", depth, seldepth);
+    if (multi_pv > 1)
+        buf_printf(&out, " multipv %d", line);
+    buf_printf(&out, " score ");
+    if (score >= MATE_BOUND)
+        buf_printf(&out, "mate %d", (MATE_SCORE - score + 1) / 2);
+    else if (score <= -MATE_BOUND)
+        buf_printf(&out, "mate %d", -(MATE_SCORE + score) / 2);
+    else
+        buf_printf(&out, "cp %d", score * 100);
+    if (bound == LOWER_BOUND)
+        buf_printf(&out, " lowerbound");
+    else if (bound == UPPER_BOUND)
+        buf_printf(&out, " upperbound");
+    buf_printf(&out, " nodes %llu nps %llu time %ld hashfull %d pv",
+            (unsigned long long)nodes, (unsigned long long)nps, elapsed,
+            hashfull());
+    buf_pv(&out, best);
+    buf_printf(&out, "\n");
+    buf_flush(&out);
+}
+
+/*******************************************************************************
+ * Prints the root move about to be searched, once the search has run long
+ * enough for a GUI to care, and no more often than every CURRMOVE_INTERVAL
+ *
+ * @param move The root move
+ * @param depth The depth of the current iteration
+ * @param number The position of the move in the root move list, from 1
+ ******************************************************************************/
+void report_currmove(Move* move, int depth, int number)
+{
+    long elapsed = tm_elapsed(&time_manager);
+    if (elapsed < CURRMOVE_DELAY || elapsed - last_currmove < CURRMOVE_INTERVAL)
+        return;
+    last_currmove = elapsed;
+    OutBuffer out;
+    buf_init(&out, 1);
+    buf_printf(&out, "info depth %d currmove ", depth);
+    buf_move(&out, move);
+    buf_printf(&out, " currmovenumber %d\n", number);
+    buf_flush(&out);
+}
+
+/*******************************************************************************
+ * Finds the expected reply to a move from the transposition table, so that it
+ * can be sent as the move to ponder on
+ *
+ * @param board The board the move is made on
+ * @param move The move to find the reply to
+ * @param ponder Set to the reply, or given an empty source square if the table
+ *               has no legal reply stored
+ ******************************************************************************/
+void find_ponder_move(Board* board, Move* move, Move* ponder)
+{
+    ponder->src = EMPTY;
+    Board temp_board;
+    memcpy(&temp_board, board, sizeof(Board));
+    move_piece(&temp_board, move);
+    TEntry entry;
+    if (!probe_hash(&temp_board, &entry) || !entry.move)
+        return;
+    Cand cans[MOVES_PER_POSITION];
+    int num_moves = gen_all_moves(&temp_board, cans);
+    int i;
+    for (i = 0; i < num_moves; ++i)
+    {
+        if (pack_move(&cans[i].move) == entry.move)
+        {
+            *ponder = cans[i].move;
+            return;
+        }
+    }
+}
+
+/*******************************************************************************
+ * Switches a ponder search to a normal timed search when the opponent played
+ * the expected move. The search keeps running; only its clock starts now. The
+ * new limits are in place before pondering is cleared, which is what lets the
+ * search thread look at them.
+ *
+ * @param limits The limits given with the go ponder command
+ * @param color The color of the side the search is for
+ ******************************************************************************/
+void ponderhit(SearchLimits* limits, int color)
+{
+    tm_ponderhit(&time_manager, limits, color);
+    pondering = 0;
+}
+
+/*******************************************************************************
+ * Searches the root moves for one line of an iteration, starting with a narrow
+ * aspiration window around the line's score from the previous iteration and
+ * widening it on every fail high or fail low. The best move ends up first in
+ * the list.
+ *
+ * @param board The board to search
+ * @param roots The root moves left for this line
+ * @param num_moves The number of root moves left
+ * @param score The score of this line in the previous iteration
+ * @param depth The depth of the iteration
+ * @param line The number of the line in MultiPV mode, from 1
+ * @return The score of the line, or garbage if the search was stopped
+ ******************************************************************************/
+int search_line(Board* board, RootMove* roots, int num_moves, int score,
+        int depth, int line)
+{
+    int delta = ASPIRATION_DELTA;
+    int alpha = -MATE_SCORE;
+    int beta = MATE_SCORE;
+    if (depth >= ASPIRATION_MIN_DEPTH)
+    {
+        alpha = (score - delta > -MATE_SCORE) ? score - delta : -MATE_SCORE;
+        beta = (score + delta < MATE_SCORE) ? score + delta : MATE_SCORE;
+    }
+    while (1)
+    {
+        score = search_root(board, roots, num_moves, alpha, beta, depth);
+        if (stop_search)
+            break;
+        if (score <= alpha && alpha > -MATE_SCORE)
+        {
+            report_iteration(&roots[0].move, depth, line, score, UPPER_BOUND);
+            beta = (alpha + beta) / 2;
+            alpha = (score - delta > -MATE_SCORE) ? score - delta :
+                -MATE_SCORE;
+        }
+        else if (score >= beta && beta < MATE_SCORE)
+        {
+            report_iteration(&roots[0].move, depth, line, score, LOWER_BOUND);
+            beta = (score + delta < MATE_SCORE) ? score + delta : MATE_SCORE;
+        }
+        else
+            break;
+        delta += delta;
+        if (delta > ASPIRATION_MAX_DELTA)
+        {
+            alpha = -MATE_SCORE;
+            beta = MATE_SCORE;
+        }
+    }
+    return score;
+}
+
+/*******************************************************************************
+ * Fills the root move list from the legal moves of the position, dropping
+ * every move that is not in the searchmoves list of the limits. An empty
+ * list keeps all moves.
+ *
+ * @param board The board to search
+ * @param roots The root move list to fill
+ * @param limits The limits given with the go command
+ * @return The number of root moves
+ ******************************************************************************/
+int gen_root_moves(Board* board, RootMove* roots, SearchLimits* limits)
+{
+    Cand cands[MOVES_PER_POSITION];
+    int num_moves = gen_all_moves(board, cands);
+    int kept = 0;
+    int i, j;
+    for (i = 0; i < num_moves; ++i)
+    {
+        for (j = 0; j < limits->num_searchmoves; ++j)
+        {
+            if (pack_move(&cands[i].move) == limits->searchmoves[j])
+                break;
+        }
+        if (limits->num_searchmoves && j == limits->num_searchmoves)
+            continue;
+        roots[kept].move = cands[i].move;
+        roots[kept].score = -MATE_SCORE;
+        roots[kept].nodes = 0;
+        kept++;
+    }
+    return kept;
+}
+
+/*******************************************************************************
+ * Checks whether the root position needs no real search: there is only one
+ * legal move, the game is already drawn by rule, or a move completes a
+ * threefold repetition while we are behind. Analysis searches never take
+ * the fast path.
+ *
+ * @param board The board to search
+ * @param roots The legal root moves
+ * @param num_moves The number of legal root moves
+ * @param limits The limits given with the go command
+ * @param move Set to the move to play without any search, or given an empty
+ *             source square if a shallow search should pick it
+ * @return The reason the fast path was taken, or NULL to search normally
+ ******************************************************************************/
+char* fast_path(Board* board, RootMove* roots, int num_moves,
+        SearchLimits* limits, Move* move)
+{
+    move->src = EMPTY;
+    if (limits->infinite || multi_pv > 1)
+        return NULL;
+    if (num_moves == 1)
+        return "only one legal move";
+    if (board->halfmove >= FIFTY_MOVE_PLIES)
+        return "draw by the fifty-move rule";
+    if (is_material_draw(board))
+        return "draw by insufficient material";
+    if (get_board_value(board) >= DRAW_SCORE)
+        return NULL;
+    int i;
+    for (i = 0; i < num_moves; ++i)
+    {
+        Board* child = &search_stack[1].board;
+        memcpy(child, board, sizeof(Board));
+        move_piece(child, &roots[i].move);
+        add_position(child);
+        int repetitions = repetition_count(child);
+        remove_position();
+        if (repetitions >= 2)
+        {
+            *move = roots[i].move;
+            return "claiming a draw by threefold repetition";
+        }
+    }
+    return NULL;
+}
+
+/*******************************************************************************
+ * Returns the best move to make in a given position, searching iteratively
+ * deeper until the depth, node or time limits are reached. With MultiPV set
+ * every iteration searches the best multi_pv root moves one after the other,
+ * each time excluding the moves already chosen. The caller clears
+ * stop_search before starting the search. While pondering is set no time
+ * limit applies.
+ *
+ * @param board The board to search for the best move
+ * @param limits The limits given with the go command
+ * @param ponder Set to the expected reply to the best move, if one is known
+ ******************************************************************************/
+Move find_best_move(Board* board, SearchLimits* limits, Move* ponder)
+{
+    tm_init(&time_manager, limits, board->to_move);
+    nodes = 0;
+    stats_clear();
+    trace_clear();
+    int depth = MAX_PLY - 1;
+    if (limits->depth > 0 && limits->depth < depth)
+        depth = limits->depth;
+    RootMove roots[MOVES_PER_POSITION];
+    int num_moves = gen_root_moves(board, roots, limits);
+    ponder->src = EMPTY;
+    if (!num_moves)
+    {
+        Move none = {0};
+        return none;
+    }
+    Move fast_move;
+    char* reason = fast_path(board, roots, num_moves, limits, &fast_move);
+    if (reason)
+    {
+        OutBuffer out;
+        buf_init(&out, 1);
+        buf_printf(&out, "info string %s\n", reason);
+        buf_flush(&out);
+        if (fast_move.src)
+        {
+            find_ponder_move(board, &fast_move, ponder);
+            return fast_move;
+        }
+        if (depth > FAST_PATH_DEPTH)
+            depth = FAST_PATH_DEPTH;
+    }
+    Cand cands[MOVES_PER_POSITION];
+    Cand bestmove;
+    bestmove.weight = -9001;
+    /* The capture shortcut only makes sense when a single move is wanted */
+    int num_attack_moves = 0;
+    if (!reason && multi_pv == 1 && !limits->num_searchmoves)
+        num_attack_moves = gen_all_attack_moves(board, cands);
+    int i;
+    for (i = 0; i < num_attack_moves; ++i)
+    {
+        int temp_weight = 0;
+        temp_weight = -alphaBetaMax_attack(board, &cands[i], -300, 300, 0);
+        cands[i].weight = temp_weight;
+        if (debug_mode)
+        {
+            OutBuffer out;
+            buf_init(&out, 1);
+            buf_printf(&out, "info string capture ");
+            buf_move(&out, &cands[i].move);
+            buf_printf(&out, " exchange %d\n", cands[i].weight);
+            buf_flush(&out);
+        }
+        if (cands[i].weight > bestmove.weight)
+            bestmove = cands[i];
+    }
+    int bv = get_board_value(board);
+    if (bv < 0)
+        bv *= -1;
+    if (bestmove.weight > bv)
+    {
+        OutBuffer out;
+        buf_init(&out, 1);
+        buf_printf(&out, "info string capture ");
+        buf_move(&out, &bestmove.move);
+        buf_printf(&out, " wins %d, skipping search\n", bestmove.weight);
+        buf_flush(&out);
+        find_ponder_move(board, &bestmove.move, ponder);
+        return bestmove.move;
+    }
+
+    search_clear();
+    root_pv_length = 0;
+    bestmove.move = roots[0].move;
+    int num_lines = (multi_pv < num_moves) ? multi_pv : num_moves;
+    int scores[MOVES_PER_POSITION] = {0};
+    last_currmove = 0;
+    int j;
+    for (j = 1; j <= depth; ++j)
+    {
+        seldepth = 0;
+        /* Timed on its own, as a ponderhit restarts the search's clock */
+        long iteration_start = get_time_ms();
+        int best_changed = 0;
+        int line;
+        for (i = 0; i < num_moves; ++i)
+            roots[i].nodes = 0;
+        uint64_t iteration_nodes = nodes;
+        for (line = 0; line < num_lines; ++line)
+        {
+            int score = search_line(board, roots + line, num_moves - line,
+                    scores[line], j, line + 1);
+            /* Results of an interrupted line are not trusted */
+            if (stop_search)
+                break;
+            scores[line] = score;
+            report_iteration(&roots[line].move, j, line + 1, score,
+                    EXACT_BOUND);
+            if (line == 0)
+            {
+                memcpy(root_pv, pv_table[0], sizeof(Move) * pv_length[0]);
+                root_pv_length = pv_length[0];
+                best_changed = !same_move(&bestmove.move, &roots[0].move);
+                bestmove.move = roots[0].move;
+            }
+        }
+        if (stop_search)
+            break;
+        iteration_nodes = nodes - iteration_nodes;
+        int best_share = iteration_nodes ?
+            (int)(roots[0].nodes * 100 / iteration_nodes) : 100;
+        /* The moves after the chosen lines are tried in order of effort */
+        if (num_moves > num_lines)
+            qsort(roots + num_lines, num_moves - num_lines, sizeof(RootMove),
+                    comp_root_nodes);
+        if (!pondering && tm_stop_iterating(&time_manager,
+                    get_time_ms() - iteration_start, best_changed,
+                    best_share))
+            break;
+    }
+    for (i = 0; debug_mode && i < num_moves; ++i)
+    {
+        OutBuffer out;
+        buf_init(&out, 1);
+        buf_printf(&out, "info string ");
+        buf_move(&out, &roots[i].move);
+        buf_printf(&out, " score %d nodes %llu\n", roots[i].score,
+                (unsigned long long)roots[i].nodes);
+        buf_flush(&out);
+    }
+    if (root_pv_length > 1 && same_move(&root_pv[0], &bestmove.move))
+        *ponder = root_pv[1];
+    else
+        find_ponder_move(board, &bestmove.move, ponder);
+    return bestmove.move;
+}
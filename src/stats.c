@@ -0,0 +1,102 @@
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "board.h"
+#include "io.h"
+#include "stats.h"
+
+SearchStats search_stats;
+
+const char* phase_names[NUM_PHASES] = {"gen", "legality", "eval", "tt"};
+
+/*******************************************************************************
+ * Returns a cheap, steadily increasing tick count for timing the phases of
+ * the search: the time stamp counter where there is one, nsec otherwise
+ ******************************************************************************/
+uint64_t stats_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/*******************************************************************************
+ * Resets all search statistics, done at the start of every search
+ ******************************************************************************/
+void stats_clear()
+{
+    memset(&search_stats, 0, sizeof(SearchStats));
+}
+
+/*******************************************************************************
+ * Returns part as a percentage of whole, or 0 if whole is 0
+ ******************************************************************************/
+double stats_percent(uint64_t part, uint64_t whole)
+{
+    return whole ? 100.0 * part / whole : 0;
+}
+
+/*******************************************************************************
+ * Prints the statistics of the last search as info string lines, or a note
+ * that they were not compiled in
+ ******************************************************************************/
+void stats_print()
+{
+    OutBuffer out;
+    buf_init(&out, 1);
+    if (!STATS_ENABLED)
+    {
+        buf_printf(&out, "info string search statistics are not compiled in, "
+                "build with make stats\n");
+        buf_flush(&out);
+        return;
+    }
+    SearchStats* s = &search_stats;
+    uint64_t total = s->main_nodes + s->qnodes;
+    buf_printf(&out, "info string nodes %llu main %llu qnodes %llu "
+            "(%.1f%%)\n", (unsigned long long)total,
+            (unsigned long long)s->main_nodes, (unsigned long long)s->qnodes,
+            stats_percent(s->qnodes, total));
+
+    int last_ply = STATS_PLIES - 1;
+    while (last_ply > 0 && !s->nodes_by_ply[last_ply])
+        last_ply--;
+    buf_printf(&out, "info string nodes by ply");
+    int i;
+    for (i = 0; i <= last_ply; ++i)
+        buf_printf(&out, " %llu", (unsigned long long)s->nodes_by_ply[i]);
+    buf_printf(&out, "\n");
+
+    buf_printf(&out, "info string tt probes %llu hits %llu (%.1f%%) "
+            "cutoffs %llu (%.1f%%)\n", (unsigned long long)s->tt_probes,
+            (unsigned long long)s->tt_hits,
+            stats_percent(s->tt_hits, s->tt_probes),
+            (unsigned long long)s->tt_cutoffs,
+            stats_percent(s->tt_cutoffs, s->tt_probes));
+
+    uint64_t cutoffs = 0;
+    for (i = 0; i < STATS_MOVE_INDICES; ++i)
+        cutoffs += s->beta_cutoffs[i];
+    buf_printf(&out, "info string beta cutoffs %llu first move %.1f%% "
+            "by move", (unsigned long long)cutoffs,
+            stats_percent(s->beta_cutoffs[0], cutoffs));
+    for (i = 0; i < STATS_MOVE_INDICES; ++i)
+        buf_printf(&out, " %llu", (unsigned long long)s->beta_cutoffs[i]);
+    buf_printf(&out, "\n");
+
+    buf_printf(&out, "info string illegal moves rejected %llu\n",
+            (unsigned long long)s->illegal_moves);
+
+    buf_printf(&out, "info string ticks");
+    for (i = 0; i < NUM_PHASES; ++i)
+        buf_printf(&out, " %s %llu", phase_names[i],
+                (unsigned long long)s->phase_ticks[i]);
+    buf_printf(&out, "\n");
+    buf_flush(&out);
+}
@@ -0,0 +1,157 @@
+#include <string.h>
+#include <time.h>
+#include "board.h"
+#include "timeman.h"
+
+/*******************************************************************************
+ * Returns the time of a monotonic clock in msec, which steps of the wall clock
+ * cannot move
+ ******************************************************************************/
+long get_time_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*******************************************************************************
+ * Resets search limits to "no limit" for every field
+ *
+ * @param limits The limits to reset
+ ******************************************************************************/
+void clear_limits(SearchLimits* limits)
+{
+    memset(limits, 0, sizeof(SearchLimits));
+    limits->depth = -1;
+    limits->wtime = -1;
+    limits->btime = -1;
+    limits->movetime = -1;
+}
+
+/*******************************************************************************
+ * Computes the soft and hard time limits for a search. The soft limit is the
+ * time we aim to spend on the move and is checked between iterations; the
+ * hard limit is checked while searching and aborts the current iteration.
+ * A limit of -1 means there is no limit.
+ *
+ * @param tm The time manager to set up
+ * @param limits The limits sent with the go command
+ * @param color The color of the side to move
+ ******************************************************************************/
+void tm_init(TimeManager* tm, SearchLimits* limits, int color)
+{
+    tm->start = get_time_ms();
+    tm->soft_limit = -1;
+    tm->hard_limit = -1;
+    tm->max_nodes = limits->nodes;
+    tm->last_iteration = 0;
+    tm->instability = 0;
+    if (limits->infinite)
+        return;
+
+    if (limits->movetime >= 0)
+    {
+        long time = limits->movetime - MOVE_OVERHEAD;
+        if (time < 1)
+            time = 1;
+        tm->soft_limit = time;
+        tm->hard_limit = time;
+        return;
+    }
+
+    long time_left = (color == WHITE) ? limits->wtime : limits->btime;
+    long inc = (color == WHITE) ? limits->winc : limits->binc;
+    if (time_left < 0)
+        return;
+    int moves_to_go = limits->movestogo > 0 ? limits->movestogo :
+        DEFAULT_MOVES_TO_GO;
+    long usable = time_left - MOVE_OVERHEAD;
+    if (usable < 1)
+        usable = 1;
+
+    tm->soft_limit = usable / moves_to_go + inc * 3 / 4;
+    tm->hard_limit = tm->soft_limit * 4;
+    /* Never plan to use more than a fraction of what is left on the clock */
+    if (tm->hard_limit > usable / 2 && moves_to_go > 1)
+        tm->hard_limit = usable / 2;
+    if (tm->hard_limit > usable)
+        tm->hard_limit = usable;
+    if (tm->soft_limit > tm->hard_limit)
+        tm->soft_limit = tm->hard_limit;
+}
+
+/*******************************************************************************
+ * Starts the clock of a ponder search when the opponent played the expected
+ * move. Only the start and the time limits are replaced, each with a single
+ * atomic store, so the search thread can keep reading them and keeps what it
+ * learned about the position's instability while pondering.
+ *
+ * @param tm The time manager of the running search
+ * @param limits The limits sent with the go ponder command
+ * @param color The color of the side the search is for
+ ******************************************************************************/
+void tm_ponderhit(TimeManager* tm, SearchLimits* limits, int color)
+{
+    TimeManager fresh;
+    tm_init(&fresh, limits, color);
+    atomic_store(&tm->soft_limit, atomic_load(&fresh.soft_limit));
+    atomic_store(&tm->hard_limit, atomic_load(&fresh.hard_limit));
+    atomic_store(&tm->start, atomic_load(&fresh.start));
+}
+
+/*******************************************************************************
+ * Returns the time passed since the search started in msec
+ ******************************************************************************/
+long tm_elapsed(TimeManager* tm)
+{
+    return get_time_ms() - tm->start;
+}
+
+/*******************************************************************************
+ * Checks the hard limits of the search. The node limit is checked every call
+ * so that node limited searches are reproducible, the clock only every
+ * TIME_CHECK_NODES nodes.
+ *
+ * @param tm The time manager of the running search
+ * @param nodes The number of nodes searched so far
+ * @return 1 if the search has to stop now, 0 otherwise
+ ******************************************************************************/
+int tm_out_of_time(TimeManager* tm, uint64_t nodes)
+{
+    if (tm->max_nodes && nodes >= tm->max_nodes)
+        return 1;
+    if (tm->hard_limit < 0 || nodes % TIME_CHECK_NODES)
+        return 0;
+    return tm_elapsed(tm) >= tm->hard_limit;
+}
+
+/*******************************************************************************
+ * Decides between iterations whether to start another one. The soft limit is
+ * stretched while the best move keeps changing or while it took only a small
+ * share of the nodes, and shortened when it took most of them. No iteration
+ * is started that would likely run into the hard limit before it finishes.
+ *
+ * @param tm The time manager of the running search
+ * @param iteration_time The time the last iteration took in msec
+ * @param best_changed Whether the last iteration changed the best move
+ * @param best_share The percentage of the iteration's nodes spent on the
+ *                   best move
+ * @return 1 if iterative deepening should stop, 0 otherwise
+ ******************************************************************************/
+int tm_stop_iterating(TimeManager* tm, long iteration_time, int best_changed,
+        int best_share)
+{
+    tm->instability = tm->instability / 2 + (best_changed ? 4 : 0);
+    tm->last_iteration = iteration_time;
+    if (tm->soft_limit < 0)
+        return 0;
+    long elapsed = tm_elapsed(tm);
+    long soft = tm->soft_limit * (4 + tm->instability) / 4;
+    soft = soft * (100 + NODE_SHARE_NEUTRAL - best_share) / 100;
+    if (soft > tm->hard_limit)
+        soft = tm->hard_limit;
+    if (elapsed >= soft)
+        return 1;
+    /* Each iteration takes a few times longer than the one before it */
+    return elapsed + iteration_time * 2 > tm->hard_limit;
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "board.h"
+#include "trace.h"
+
+TraceBuffer trace_buffer = {NULL, 0};
+char trace_file[TRACE_PATH_LENGTH] = "";
+
+/*******************************************************************************
+ * Turns tracing on, writing to the given file, or off for an empty name or
+ * the UCI "<empty>". The ring is allocated only while tracing is on.
+ *
+ * @param filename The file that searches are appended to, or NULL
+ ******************************************************************************/
+void trace_enable(char* filename)
+{
+    if (!filename || !*filename || !strcmp(filename, "<empty>"))
+    {
+        free(trace_buffer.records);
+        trace_buffer.records = NULL;
+        trace_file[0] = '\0';
+        return;
+    }
+    strncpy(trace_file, filename, TRACE_PATH_LENGTH - 1);
+    trace_file[TRACE_PATH_LENGTH - 1] = '\0';
+    if (!trace_buffer.records)
+        trace_buffer.records = malloc(TRACE_RING_RECORDS *
+                sizeof(TraceRecord));
+    if (!trace_buffer.records)
+        perror("from trace_enable");
+    trace_buffer.written = 0;
+}
+
+/*******************************************************************************
+ * Empties the ring, done at the start of every search
+ ******************************************************************************/
+void trace_clear()
+{
+    trace_buffer.written = 0;
+}
+
+/*******************************************************************************
+ * Adds a record for a node whose search just returned
+ *
+ * @param ply The ply of the node
+ * @param move The move that led to the node
+ * @param alpha The lower bound of the window the move was searched with
+ * @param beta The upper bound of the window
+ * @param score The score the move got
+ * @param depth The depth the node was searched to
+ * @param reduction The late move reduction applied to the depth
+ * @param type One of enum trace_node_type
+ * @param tt One of enum trace_tt_result for the node's own table probe
+ ******************************************************************************/
+void trace_node(int ply, Move* move, int alpha, int beta, int score,
+        int depth, int reduction, int type, int tt)
+{
+    TraceRecord* record = &trace_buffer.records[trace_buffer.written++ &
+        (TRACE_RING_RECORDS - 1)];
+    record->move = pack_move(move);
+    record->alpha = alpha;
+    record->beta = beta;
+    record->score = score;
+    record->ply = ply;
+    record->depth = depth > 0 ? depth : 0;
+    record->reduction = reduction;
+    record->type = type;
+    record->tt = tt;
+    record->bound = score >= beta ? TRACE_FAIL_HIGH :
+        (score <= alpha ? TRACE_FAIL_LOW : TRACE_EXACT);
+    record->unused = 0;
+}
+
+/*******************************************************************************
+ * Appends the records of the last search to the trace file, oldest first,
+ * behind a header that says how many there are
+ *
+ * @param nodes The number of nodes the search took
+ ******************************************************************************/
+void trace_flush(uint64_t nodes)
+{
+    if (!trace_buffer.records)
+        return;
+    FILE* file = fopen(trace_file, "ab");
+    if (!file)
+    {
+        perror("from trace_flush");
+        return;
+    }
+    TraceHeader header;
+    memset(&header, 0, sizeof(TraceHeader));
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    header.written = trace_buffer.written;
+    header.count = trace_buffer.written < TRACE_RING_RECORDS ?
+        trace_buffer.written : TRACE_RING_RECORDS;
+    header.nodes = nodes;
+    uint64_t first = (trace_buffer.written - header.count) &
+        (TRACE_RING_RECORDS - 1);
+    uint64_t to_end = TRACE_RING_RECORDS - first;
+    if (to_end > header.count)
+        to_end = header.count;
+    if (fwrite(&header, sizeof(TraceHeader), 1, file) != 1 ||
+            fwrite(trace_buffer.records + first, sizeof(TraceRecord), to_end,
+                file) != to_end ||
+            fwrite(trace_buffer.records, sizeof(TraceRecord),
+                header.count - to_end, file) != header.count - to_end)
+        perror("from trace_flush");
+    fclose(file);
+}
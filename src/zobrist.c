@@ -5,30 +5,131 @@
 
 uint64_t random_nums[RANDOM_SIZE];
 TEntry* zobrist_hash = NULL;
+uint64_t table_size = 0;
+
+uint64_t cuckoo_keys[CUCKOO_SIZE];
+uint8_t cuckoo_src[CUCKOO_SIZE];
+uint8_t cuckoo_dest[CUCKOO_SIZE];
 
 void zobrist_init()
 {
     uint64_t i;
+    /* rand() only gives 31 bits, so each key is built from several calls */
+    for (i = 0; i < RANDOM_SIZE; ++i)
+        random_nums[i] = ((uint64_t)rand() << 62) ^ ((uint64_t)rand() << 31) ^
+            (uint64_t)rand();
+    cuckoo_init();
+}
+
+/*
+ * Reallocates the transposition table to the largest power of two number of
+ * entries that fits in the given number of MB, and clears it
+ */
+void zobrist_resize(uint64_t mb)
+{
+    uint64_t entries = 1;
+    if (mb < 1)
+        mb = 1;
+    while (entries * 2 * sizeof(TEntry) <= mb * 1024 * 1024)
+        entries *= 2;
     if (zobrist_hash)
         free(zobrist_hash);
-    zobrist_hash = calloc(sizeof(TEntry), TABLE_SIZE);
-    for (i = 0; i < RANDOM_SIZE; ++i)
-        random_nums[i] = rand() % HASH_SIZE;
+    table_size = entries;
+    zobrist_hash = malloc(sizeof(TEntry) * table_size);
     zobrist_clear();
 }
 
+/*
+ * Fills the cuckoo table with the key change of every move a non-pawn piece
+ * can make between two squares on an empty board, so that the key difference
+ * between two positions can be tested for being a single such move
+ */
+void cuckoo_init()
+{
+    Board empty;
+    int piece, a, b;
+    memset(&empty, 0, sizeof(Board));
+    memset(cuckoo_keys, 0, sizeof(cuckoo_keys));
+    for (piece = 0; piece < 12; ++piece)
+    {
+        int type = piece % 6;
+        int color = piece - type;
+        if (type == PAWN)
+            continue;
+        for (a = 0; a < 64; ++a)
+        {
+            uint64_t moves = EMPTY;
+            if (type == BISHOP)
+                moves = gen_bishop_moves(&empty, color, 0x1ULL << a);
+            else if (type == KNIGHT)
+                moves = gen_knight_moves(&empty, color, 0x1ULL << a);
+            else if (type == ROOK)
+                moves = gen_rook_moves(&empty, color, 0x1ULL << a);
+            else if (type == QUEEN)
+                moves = gen_queen_moves(&empty, color, 0x1ULL << a);
+            else
+                moves = gen_king_moves(&empty, color, 0x1ULL << a);
+            for (b = a + 1; b < 64; ++b)
+            {
+                if (!(moves & (0x1ULL << b)))
+                    continue;
+                uint64_t key = random_nums[64 * piece + a] ^
+                    random_nums[64 * piece + b] ^ random_nums[BLACK_TO_MOVE];
+                uint8_t src = a;
+                uint8_t dest = b;
+                uint64_t slot = CUCKOO_H1(key);
+                while (1)
+                {
+                    uint64_t tmp_key = cuckoo_keys[slot];
+                    uint8_t tmp_src = cuckoo_src[slot];
+                    uint8_t tmp_dest = cuckoo_dest[slot];
+                    cuckoo_keys[slot] = key;
+                    cuckoo_src[slot] = src;
+                    cuckoo_dest[slot] = dest;
+                    if (!tmp_key)
+                        break;
+                    key = tmp_key;
+                    src = tmp_src;
+                    dest = tmp_dest;
+                    slot = (slot == CUCKOO_H1(key)) ? CUCKOO_H2(key) :
+                        CUCKOO_H1(key);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Looks up a key difference in the cuckoo table
+ * Returns 1 and sets the squares of the move if it is a reversible piece move
+ */
+int cuckoo_lookup(uint64_t key, int* src, int* dest)
+{
+    int slot = CUCKOO_H1(key);
+    if (cuckoo_keys[slot] != key)
+    {
+        slot = CUCKOO_H2(key);
+        if (cuckoo_keys[slot] != key)
+            return 0;
+    }
+    *src = cuckoo_src[slot];
+    *dest = cuckoo_dest[slot];
+    return 1;
+}
+
 void zobrist_clear()
 {
     uint64_t i;
-    for (i = 0; i < TABLE_SIZE; ++i)
+    memset(zobrist_hash, 0, sizeof(TEntry) * table_size);
+    for (i = 0; i < table_size; ++i)
         zobrist_hash[i].hash = DEFUALT_VALUE;
 }
 
 int is_hashed(Board* board, int depth)
 {
-    if (zobrist_hash[board->hash % TABLE_SIZE].hash == board->hash)
+    if (zobrist_hash[board->hash & (table_size - 1)].hash == board->hash)
     {
-        if (depth <= zobrist_hash[board->hash % TABLE_SIZE].depth)
+        if (depth <= zobrist_hash[board->hash & (table_size - 1)].depth)
             return 1;
     }
     return 0;
@@ -36,13 +137,58 @@ int is_hashed(Board* board, int depth)
 
 int get_hashed_value(Board* board)
 {
-    return zobrist_hash[board->hash % TABLE_SIZE].score;
+    return zobrist_hash[board->hash & (table_size - 1)].score;
 }
 
 void set_hashed_value(Board* board, int val, int depth)
 {
-    zobrist_hash[board->hash % TABLE_SIZE].score = val;
-    zobrist_hash[board->hash % TABLE_SIZE].depth = depth;
+    zobrist_hash[board->hash & (table_size - 1)].score = val;
+    zobrist_hash[board->hash & (table_size - 1)].depth = depth;
+}
+
+/*
+ * Copies the transposition table entry for the board into entry
+ * Returns 1 if the table holds an entry for this exact position
+ */
+int probe_hash(Board* board, TEntry* entry)
+{
+    TEntry* slot = &zobrist_hash[board->hash & (table_size - 1)];
+    if (slot->hash != board->hash)
+        return 0;
+    *entry = *slot;
+    return 1;
+}
+
+/*
+ * Stores a search result for the board. A deeper result for the same position
+ * is only overwritten by an exact score
+ */
+void store_hash(Board* board, int score, int depth, int flag, uint16_t move)
+{
+    TEntry* slot = &zobrist_hash[board->hash & (table_size - 1)];
+    if (slot->hash == board->hash && slot->depth > depth &&
+            flag != EXACT_BOUND)
+        return;
+    if (!move && slot->hash == board->hash)
+        move = slot->move;
+    slot->hash = board->hash;
+    slot->score = score;
+    slot->move = move;
+    slot->depth = depth;
+    slot->flag = flag;
+}
+
+/*
+ * Returns the per mille of the table in use, sampled from its first entries
+ */
+int hashfull()
+{
+    uint64_t i;
+    int used = 0;
+    for (i = 0; i < 1000 && i < table_size; ++i)
+        if (zobrist_hash[i].hash != DEFUALT_VALUE)
+            used++;
+    return used;
 }
 
 uint64_t hash_position(Board* board)
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "board.h"
+#include "io.h"
+#include "zobrist.h"
+#include "bench.h"
+
+/* Timed samples per primitive, and untimed ones run first to warm up caches
+ * and branch predictors */
+#define MICROBENCH_SAMPLES 101
+#define MICROBENCH_WARMUP 10
+
+/* Shortest a sample may take, in nsec. Passes over the corpus are repeated
+ * until a sample takes at least this long, so clock overhead stays small. */
+#define MICROBENCH_SAMPLE_NS 1000000
+
+/* Most positions taken from the bench set */
+#define MICROBENCH_MAX_POSITIONS 64
+
+/* The corpus every primitive is run over, set up once from the bench
+ * positions */
+char fens[MICROBENCH_MAX_POSITIONS][100];
+Board boards[MICROBENCH_MAX_POSITIONS];
+Cand moves[MICROBENCH_MAX_POSITIONS][MOVES_PER_POSITION];
+int num_moves[MICROBENCH_MAX_POSITIONS];
+int num_positions_corpus = 0;
+
+/* Results are added here so the compiler cannot drop the timed calls */
+volatile uint64_t sink = 0;
+
+typedef struct
+{
+    char* name;
+    uint64_t (*pass)(void);
+} Primitive;
+
+/*******************************************************************************
+ * Returns the time of a monotonic clock in nsec
+ ******************************************************************************/
+uint64_t get_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*******************************************************************************
+ * Each pass runs one primitive once over the whole corpus and returns the
+ * number of calls it made
+ ******************************************************************************/
+uint64_t pass_load_fen()
+{
+    char fen[100];
+    Board board;
+    int i;
+    for (i = 0; i < num_positions_corpus; ++i)
+    {
+        strcpy(fen, fens[i]);
+        load_fen(&board, fen);
+        sink += board.hash;
+    }
+    return num_positions_corpus;
+}
+
+uint64_t pass_hash_position()
+{
+    int i;
+    for (i = 0; i < num_positions_corpus; ++i)
+        sink += hash_position(&boards[i]);
+    return num_positions_corpus;
+}
+
+uint64_t pass_gen_all_moves()
+{
+    Cand cans[MOVES_PER_POSITION];
+    int i;
+    for (i = 0; i < num_positions_corpus; ++i)
+        sink += gen_all_moves(&boards[i], cans);
+    return num_positions_corpus;
+}
+
+uint64_t pass_count_legal_moves()
+{
+    int i;
+    for (i = 0; i < num_positions_corpus; ++i)
+        sink += count_legal_moves(&boards[i]);
+    return num_positions_corpus;
+}
+
+uint64_t pass_is_legal()
+{
+    uint64_t calls = 0;
+    int i, j;
+    for (i = 0; i < num_positions_corpus; ++i)
+    {
+        for (j = 0; j < num_moves[i]; ++j)
+            sink += is_legal(&boards[i], moves[i][j].move);
+        calls += num_moves[i];
+    }
+    return calls;
+}
+
+/* Moves are made on a copy of the board, which is all that undoing them
+ * takes, so the copy is part of the cost */
+uint64_t pass_move_piece()
+{
+    uint64_t calls = 0;
+    Board board;
+    int i, j;
+    for (i = 0; i < num_positions_corpus; ++i)
+    {
+        for (j = 0; j < num_moves[i]; ++j)
+        {
+            memcpy(&board, &boards[i], sizeof(Board));
+            move_piece(&board, &moves[i][j].move);
+            sink += board.hash;
+        }
+        calls += num_moves[i];
+    }
+    return calls;
+}
+
+uint64_t pass_get_board_value()
+{
+    int i;
+    for (i = 0; i < num_positions_corpus; ++i)
+        sink += get_board_value(&boards[i]);
+    return num_positions_corpus;
+}
+
+/* Primitives in the order they are reported. Keep the order stable so that
+ * outputs of two builds can be diffed line by line. */
+const Primitive primitives[] = {
+    {"load_fen", pass_load_fen},
+    {"hash_position", pass_hash_position},
+    {"gen_all_moves", pass_gen_all_moves},
+    {"count_legal_moves", pass_count_legal_moves},
+    {"is_legal", pass_is_legal},
+    {"move_piece", pass_move_piece},
+    {"get_board_value", pass_get_board_value},
+};
+const int num_primitives = sizeof(primitives) / sizeof(Primitive);
+
+int comp_double(const void* one, const void* two)
+{
+    double a = *(const double*)one;
+    double b = *(const double*)two;
+    return (a > b) - (a < b);
+}
+
+/*******************************************************************************
+ * Times one primitive and prints the median and 99th percentile of its cost
+ * per call over all samples
+ *
+ * @param primitive The primitive to time
+ * @param samples The number of timed samples to take
+ ******************************************************************************/
+void run_primitive(const Primitive* primitive, int samples)
+{
+    /* Find how many passes make a sample long enough to time */
+    int passes = 1;
+    for (;;)
+    {
+        uint64_t start = get_time_ns();
+        int i;
+        for (i = 0; i < passes; ++i)
+            primitive->pass();
+        if (get_time_ns() - start >= MICROBENCH_SAMPLE_NS || passes >= 1 << 20)
+            break;
+        passes *= 2;
+    }
+
+    double* ns_per_op = malloc(samples * sizeof(double));
+    int s;
+    for (s = -MICROBENCH_WARMUP; s < samples; ++s)
+    {
+        uint64_t calls = 0;
+        uint64_t start = get_time_ns();
+        int i;
+        for (i = 0; i < passes; ++i)
+            calls += primitive->pass();
+        uint64_t elapsed = get_time_ns() - start;
+        if (s >= 0)
+            ns_per_op[s] = (double)elapsed / (calls ? calls : 1);
+    }
+    qsort(ns_per_op, samples, sizeof(double), comp_double);
+    printf("%-20s median %10.1f ns/op  p99 %10.1f ns/op\n", primitive->name,
+            ns_per_op[samples / 2], ns_per_op[(samples * 99) / 100]);
+    fflush(stdout);
+    free(ns_per_op);
+}
+
+/*******************************************************************************
+ * Measures the cost per call of the engine's primitives over the bench
+ * positions. Usage: leape-microbench [samples] [primitive]
+ ******************************************************************************/
+int main(int argc, char** argv)
+{
+    srand(12345);
+    board_init();
+    zobrist_init();
+    int samples = argc > 1 ? atoi(argv[1]) : MICROBENCH_SAMPLES;
+    if (samples < 1)
+        samples = MICROBENCH_SAMPLES;
+    char* only = argc > 2 ? argv[2] : NULL;
+
+    int i;
+    for (i = 0; i < num_bench_positions && i < MICROBENCH_MAX_POSITIONS; ++i)
+    {
+        char fen[100];
+        strcpy(fens[i], bench_positions[i]);
+        strcpy(fen, bench_positions[i]);
+        load_fen(&boards[i], fen);
+        num_moves[i] = gen_all_moves(&boards[i], moves[i]);
+        num_positions_corpus++;
+    }
+
+    printf("microbench positions %d samples %d warmup %d\n",
+            num_positions_corpus, samples, MICROBENCH_WARMUP);
+    for (i = 0; i < num_primitives; ++i)
+        if (!only || !strcmp(only, primitives[i].name))
+            run_primitive(&primitives[i], samples);
+    return 0;
+}
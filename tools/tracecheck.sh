@@ -0,0 +1,31 @@
+#!/bin/sh
+# Traces a search in which ProbCut and singular extensions fire and checks
+# that leape-tracedump rebuilds a consistent tree from it.
+# Usage: tools/tracecheck.sh [leape] [leape-tracedump]
+LEAPE=${1:-./leape}
+TRACEDUMP=${2:-./leape-tracedump}
+FEN="r2q1rk1/pp2bppp/2n1pn2/3p4/3P4/2NBPN2/PP3PPP/R2Q1RK1 w - - 0 10"
+DEPTH=9
+TRACE=$(mktemp)
+OUT=$(mktemp)
+trap 'rm -f "$TRACE" "$OUT"' EXIT
+rm -f "$TRACE"
+
+# The trace is written after bestmove, and quit waits for that to finish
+{
+    echo "setoption name TraceFile value $TRACE"
+    echo "position fen $FEN"
+    echo "go depth $DEPTH"
+    while ! grep -q bestmove "$OUT"; do
+        sleep 1
+    done
+    echo "quit"
+} | "$LEAPE" > "$OUT"
+
+"$TRACEDUMP" "$TRACE" check > "$OUT" || { cat "$OUT"; exit 1; }
+cat "$OUT"
+if grep -q "probcut 0 " "$OUT" || grep -q "singular 0$" "$OUT"; then
+    echo "tracecheck: ProbCut or singular extensions did not fire"
+    exit 1
+fi
+echo "tracecheck passed"
@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+/* Root moves listed in the summary, heaviest subtree first */
+#define TRACEDUMP_TOP_MOVES 10
+
+/* Deepest ply given its own line in the summary */
+#define TRACEDUMP_PLIES 64
+
+const char* type_names[] = {"pv", "nonpv", "qs", "probcut", "singular"};
+const char* tt_names[] = {"none", "miss", "hit", "cutoff"};
+const char* bound_names[] = {"exact", "high", "low"};
+
+/* The tree of one search, rebuilt from its records */
+TraceRecord* records;
+int* first_child;
+int* next_sibling;
+uint64_t* subtree;
+
+/*******************************************************************************
+ * Prints a packed move in UCI notation. Squares count from h1 as bit 0.
+ ******************************************************************************/
+void print_packed_move(uint16_t move)
+{
+    int src = move & 0x3F;
+    int dest = (move >> 6) & 0x3F;
+    int promote = (move >> 12) - 1;
+    printf("%c%d%c%d", 'h' - src % 8, src / 8 + 1, 'h' - dest % 8,
+            dest / 8 + 1);
+    if (promote >= 0 && promote <= 5)
+        printf("%c", "pbnrqk"[promote]);
+}
+
+/*******************************************************************************
+ * Links every record to its children. Records are written as their search
+ * returns, so the children of a record are the records one ply deeper since
+ * the last record at its own ply or above. Records from before the first one
+ * kept in the ring have no parent in the trace and become roots.
+ *
+ * @param count The number of records
+ * @param roots Set to the first root
+ ******************************************************************************/
+void build_tree(uint64_t count, int* roots)
+{
+    int pending[TRACEDUMP_PLIES + 2];
+    int last[TRACEDUMP_PLIES + 2];
+    int i;
+    for (i = 0; i < TRACEDUMP_PLIES + 2; ++i)
+        pending[i] = last[i] = -1;
+    for (i = 0; i < (int)count; ++i)
+    {
+        int ply = records[i].ply;
+        if (ply > TRACEDUMP_PLIES)
+            ply = TRACEDUMP_PLIES;
+        /* Anything deeper than a child lost its parent when the ring
+         * wrapped and is counted as part of this subtree */
+        first_child[i] = -1;
+        int tail = -1;
+        int deeper;
+        for (deeper = ply + 1; deeper < TRACEDUMP_PLIES + 2; ++deeper)
+        {
+            if (pending[deeper] < 0)
+                continue;
+            if (tail >= 0)
+                next_sibling[tail] = pending[deeper];
+            else
+                first_child[i] = pending[deeper];
+            tail = last[deeper];
+            pending[deeper] = last[deeper] = -1;
+        }
+        subtree[i] = 1;
+        int child;
+        for (child = first_child[i]; child >= 0; child = next_sibling[child])
+            subtree[i] += subtree[child];
+        next_sibling[i] = -1;
+        if (last[ply] >= 0)
+            next_sibling[last[ply]] = i;
+        else
+            pending[ply] = i;
+        last[ply] = i;
+    }
+    /* Whatever is still pending has no parent in the trace */
+    *roots = -1;
+    int tail = -1;
+    for (i = 0; i < TRACEDUMP_PLIES + 2; ++i)
+    {
+        if (pending[i] < 0)
+            continue;
+        if (tail >= 0)
+            next_sibling[tail] = pending[i];
+        else
+            *roots = pending[i];
+        tail = last[i];
+    }
+}
+
+/*******************************************************************************
+ * Prints a record and, down to the given ply, its subtree
+ ******************************************************************************/
+void print_tree(int index, int max_ply)
+{
+    TraceRecord* r = &records[index];
+    printf("%*s", 2 * r->ply, "");
+    print_packed_move(r->move);
+    printf(" ply %d depth %d window [%d, %d] score %d %s %s tt %s", r->ply,
+            r->depth, r->alpha, r->beta, r->score, bound_names[r->bound % 3],
+            type_names[r->type % NUM_TRACE_TYPES], tt_names[r->tt % 4]);
+    if (r->reduction)
+        printf(" reduced %d", r->reduction);
+    printf(" nodes %llu\n", (unsigned long long)subtree[index]);
+    if (r->ply >= max_ply)
+        return;
+    int child;
+    for (child = first_child[index]; child >= 0; child = next_sibling[child])
+        print_tree(child, max_ply);
+}
+
+int comp_subtree(const void* one, const void* two)
+{
+    uint64_t a = subtree[*(const int*)one];
+    uint64_t b = subtree[*(const int*)two];
+    return (a < b) - (a > b);
+}
+
+/*******************************************************************************
+ * Prints where a search spent its nodes: by ply, node type, table result and
+ * bound, then the root moves with the largest subtrees
+ ******************************************************************************/
+void print_summary(TraceHeader* header, int roots)
+{
+    uint64_t by_ply[TRACEDUMP_PLIES + 1] = {0};
+    uint64_t by_type[NUM_TRACE_TYPES] = {0};
+    uint64_t by_tt[4] = {0};
+    uint64_t by_bound[3] = {0};
+    uint64_t reduced = 0;
+    uint64_t reduction = 0;
+    uint64_t i;
+    for (i = 0; i < header->count; ++i)
+    {
+        TraceRecord* r = &records[i];
+        by_ply[r->ply < TRACEDUMP_PLIES ? r->ply : TRACEDUMP_PLIES]++;
+        by_type[r->type % NUM_TRACE_TYPES]++;
+        by_tt[r->tt % 4]++;
+        by_bound[r->bound % 3]++;
+        if (r->reduction)
+        {
+            reduced++;
+            reduction += r->reduction;
+        }
+    }
+    printf("records %llu written %llu nodes %llu\n",
+            (unsigned long long)header->count,
+            (unsigned long long)header->written,
+            (unsigned long long)header->nodes);
+    printf("by ply");
+    int ply;
+    for (ply = 0; ply <= TRACEDUMP_PLIES; ++ply)
+        if (by_ply[ply])
+            printf(" %d:%llu", ply, (unsigned long long)by_ply[ply]);
+    printf("\n");
+    printf("type pv %llu nonpv %llu qs %llu probcut %llu singular %llu\n",
+            (unsigned long long)by_type[TRACE_PV],
+            (unsigned long long)by_type[TRACE_NONPV],
+            (unsigned long long)by_type[TRACE_QS],
+            (unsigned long long)by_type[TRACE_PROBCUT],
+            (unsigned long long)by_type[TRACE_SINGULAR]);
+    printf("tt none %llu miss %llu hit %llu cutoff %llu\n",
+            (unsigned long long)by_tt[TRACE_TT_NONE],
+            (unsigned long long)by_tt[TRACE_TT_MISS],
+            (unsigned long long)by_tt[TRACE_TT_HIT],
+            (unsigned long long)by_tt[TRACE_TT_CUTOFF]);
+    printf("bound exact %llu high %llu low %llu\n",
+            (unsigned long long)by_bound[TRACE_EXACT],
+            (unsigned long long)by_bound[TRACE_FAIL_HIGH],
+            (unsigned long long)by_bound[TRACE_FAIL_LOW]);
+    printf("reduced %llu average reduction %.2f\n", (unsigned long long)reduced,
+            reduced ? (double)reduction / reduced : 0.0);
+
+    int num_roots = 0;
+    int index;
+    for (index = roots; index >= 0; index = next_sibling[index])
+        num_roots++;
+    int* sorted = malloc((num_roots ? num_roots : 1) * sizeof(int));
+    num_roots = 0;
+    for (index = roots; index >= 0; index = next_sibling[index])
+        sorted[num_roots++] = index;
+    qsort(sorted, num_roots, sizeof(int), comp_subtree);
+    printf("heaviest subtrees:\n");
+    int j;
+    for (j = 0; j < num_roots && j < TRACEDUMP_TOP_MOVES; ++j)
+    {
+        TraceRecord* r = &records[sorted[j]];
+        printf("  ");
+        print_packed_move(r->move);
+        printf(" ply %d depth %d score %d nodes %llu (%.1f%%)\n", r->ply,
+                r->depth, r->score, (unsigned long long)subtree[sorted[j]],
+                100.0 * subtree[sorted[j]] / header->count);
+    }
+    free(sorted);
+}
+
+/*******************************************************************************
+ * Checks that the rebuilt tree matches the search that wrote it. A node
+ * searches its children inside its own window negated, so every child one ply
+ * below a record must have its window there. ProbCut and singular records are
+ * searched with windows of their own and are only checked as parents.
+ *
+ * @param count The number of records
+ * @return The number of children found outside their parent's window
+ ******************************************************************************/
+int check_tree(uint64_t count)
+{
+    int violations = 0;
+    uint64_t i;
+    for (i = 0; i < count; ++i)
+    {
+        TraceRecord* parent = &records[i];
+        int child;
+        for (child = first_child[i]; child >= 0; child = next_sibling[child])
+        {
+            TraceRecord* r = &records[child];
+            if (r->ply != parent->ply + 1 || r->type == TRACE_PROBCUT ||
+                    r->type == TRACE_SINGULAR)
+                continue;
+            if (r->alpha >= -parent->beta && r->beta <= -parent->alpha)
+                continue;
+            if (violations++ < TRACEDUMP_TOP_MOVES)
+            {
+                printf("  ");
+                print_packed_move(r->move);
+                printf(" ply %d window [%d, %d] is outside [%d, %d] of ",
+                        r->ply, r->alpha, r->beta, -parent->beta,
+                        -parent->alpha);
+                print_packed_move(parent->move);
+                printf("\n");
+            }
+        }
+    }
+    return violations;
+}
+
+/*******************************************************************************
+ * Summarizes every search in a trace file written by Leape's TraceFile
+ * option, and with a ply given also prints each search tree down to it. With
+ * check instead of a ply the trees are checked with check_tree, and the exit
+ * status is 1 if any of them is wrong.
+ * Usage: leape-tracedump <file> [ply | check]
+ ******************************************************************************/
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <trace file> [ply | check]\n", argv[0]);
+        return 1;
+    }
+    int check = argc > 2 && !strcmp(argv[2], "check");
+    int max_ply = (argc > 2 && !check) ? atoi(argv[2]) : -1;
+    int failed = 0;
+    FILE* file = fopen(argv[1], "rb");
+    if (!file)
+    {
+        perror("from main");
+        return 1;
+    }
+    TraceHeader header;
+    int search = 0;
+    while (fread(&header, sizeof(TraceHeader), 1, file) == 1)
+    {
+        if (header.magic != TRACE_MAGIC || header.version != TRACE_VERSION ||
+                header.record_size != sizeof(TraceRecord))
+        {
+            fprintf(stderr, "not a version %d trace file\n", TRACE_VERSION);
+            fclose(file);
+            return 1;
+        }
+        uint64_t count = header.count ? header.count : 1;
+        records = malloc(count * sizeof(TraceRecord));
+        first_child = malloc(count * sizeof(int));
+        next_sibling = malloc(count * sizeof(int));
+        subtree = malloc(count * sizeof(uint64_t));
+        if (fread(records, sizeof(TraceRecord), header.count, file) !=
+                header.count)
+        {
+            fprintf(stderr, "trace file is truncated\n");
+            fclose(file);
+            return 1;
+        }
+        int roots;
+        build_tree(header.count, &roots);
+        printf("search %d\n", ++search);
+        print_summary(&header, roots);
+        if (check)
+        {
+            int violations = check_tree(header.count);
+            printf("check %s: %d children outside their parent's window\n",
+                    violations ? "FAILED" : "passed", violations);
+            failed |= violations > 0;
+        }
+        if (max_ply >= 0)
+        {
+            int index;
+            for (index = roots; index >= 0; index = next_sibling[index])
+                print_tree(index, max_ply);
+        }
+        printf("\n");
+        free(records);
+        free(first_child);
+        free(next_sibling);
+        free(subtree);
+    }
+    fclose(file);
+    return failed;
+}